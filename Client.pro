@@ -13,6 +13,11 @@ SOURCES += \
     mainwindow.cpp \
     chatwindow.cpp \
     chatclient.cpp \
+    wirecodec.cpp \
+    framedecoder.cpp \
+    metrics.cpp \
+    sqlitetuning.cpp \
+    sqlstatementcache.cpp \
     database.cpp
 
 HEADERS += \
@@ -20,6 +25,11 @@ HEADERS += \
     mainwindow.h \
     chatwindow.h \
     chatclient.h \
+    wirecodec.h \
+    framedecoder.h \
+    metrics.h \
+    sqlitetuning.h \
+    sqlstatementcache.h \
     database.h
 
 FORMS += \
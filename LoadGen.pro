@@ -0,0 +1,19 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = ChatLoadGen
+TEMPLATE = app
+
+SOURCES += \
+    loadgenmain.cpp \
+    loadbot.cpp \
+    wirecodec.cpp \
+    framedecoder.cpp
+
+HEADERS += \
+    loadbot.h \
+    wirecodec.h \
+    framedecoder.h
@@ -12,12 +12,48 @@ SOURCES += \
     mainwindow.cpp \
     chatserver.cpp \
     serverworker.cpp \
+    framedmessage.cpp \
+    wirecodec.cpp \
+    framedecoder.cpp \
+    iothreadpool.cpp \
+    groupindex.cpp \
+    messagestore.cpp \
+    presencebatcher.cpp \
+    sessionregistry.cpp \
+    sessiontoken.cpp \
+    dbreadpool.cpp \
+    relayframe.cpp \
+    loginservice.cpp \
+    metrics.cpp \
+    metricsserver.cpp \
+    metricspanel.cpp \
+    tracer.cpp \
+    sqlitetuning.cpp \
+    sqlstatementcache.cpp \
     database.cpp
 
 HEADERS += \
     mainwindow.h \
     chatserver.h \
     serverworker.h \
+    framedmessage.h \
+    wirecodec.h \
+    framedecoder.h \
+    iothreadpool.h \
+    groupindex.h \
+    messagestore.h \
+    presencebatcher.h \
+    sessionregistry.h \
+    sessiontoken.h \
+    dbreadpool.h \
+    relayframe.h \
+    loginservice.h \
+    metrics.h \
+    metricsserver.h \
+    metricspanel.h \
+    tracer.h \
+    sqlitetuning.h \
+    sqlstatementcache.h \
     database.h
 
 FORMS += \
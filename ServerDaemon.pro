@@ -0,0 +1,55 @@
+QT += core network sql
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = ChatServerd
+TEMPLATE = app
+
+SOURCES += \
+    serverdmain.cpp \
+    serverdaemon.cpp \
+    chatserver.cpp \
+    serverworker.cpp \
+    framedmessage.cpp \
+    wirecodec.cpp \
+    framedecoder.cpp \
+    iothreadpool.cpp \
+    groupindex.cpp \
+    messagestore.cpp \
+    presencebatcher.cpp \
+    sessionregistry.cpp \
+    sessiontoken.cpp \
+    dbreadpool.cpp \
+    relayframe.cpp \
+    loginservice.cpp \
+    metrics.cpp \
+    metricsserver.cpp \
+    tracer.cpp \
+    sqlitetuning.cpp \
+    sqlstatementcache.cpp \
+    database.cpp
+
+HEADERS += \
+    serverdaemon.h \
+    chatserver.h \
+    serverworker.h \
+    framedmessage.h \
+    wirecodec.h \
+    framedecoder.h \
+    iothreadpool.h \
+    groupindex.h \
+    messagestore.h \
+    presencebatcher.h \
+    sessionregistry.h \
+    sessiontoken.h \
+    dbreadpool.h \
+    relayframe.h \
+    loginservice.h \
+    metrics.h \
+    metricsserver.h \
+    tracer.h \
+    sqlitetuning.h \
+    sqlstatementcache.h \
+    database.h
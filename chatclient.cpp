@@ -1,10 +1,17 @@
 #include "chatclient.h"
 #include <QDebug>
-#include <QDataStream>
+#include <QJsonArray>
+#include <QRandomGenerator>
 
 ChatClient::ChatClient(QObject *parent)
     : QObject(parent)
     , m_clientSocket(new QTcpSocket(this))
+    , m_serverPort(0)
+    , m_encoding(WireCodec::Json)
+    , m_preferCbor(true)
+    // 服务器按(用户, client_id)去重，同一用户的多个设备和重启后的客户端不能从同一个值开始编号
+    , m_lastClientId(static_cast<qint64>(QRandomGenerator::global()->generate64() >> 12))
+    , m_sessionReady(false)
 {
     connect(m_clientSocket, &QTcpSocket::connected, this, &ChatClient::onConnected);
     connect(m_clientSocket, &QTcpSocket::disconnected, this, &ChatClient::onDisconnected);
@@ -29,9 +36,18 @@ void ChatClient::connectToServer(const QHostAddress &address, quint16 port)
         m_clientSocket->disconnectFromHost();
         m_clientSocket->waitForDisconnected(1000);
     }
+    m_serverAddress = address;
+    m_serverPort = port;
     m_clientSocket->connectToHost(address, port);
 }
 
+void ChatClient::reconnectToServer()
+{
+    if (m_serverPort == 0)
+        return;
+    connectToServer(m_serverAddress, m_serverPort);
+}
+
 void ChatClient::disconnectFromServer()
 {
     if (m_clientSocket->state() == QAbstractSocket::ConnectedState) {
@@ -46,68 +62,98 @@ bool ChatClient::isConnected() const
 
 void ChatClient::sendJson(const QJsonObject &json)
 {
+    // 聊天消息在确认之前一直保留；会话还没恢复时先排队，resume_success后再发
+    if (json.contains("client_id")) {
+        m_unacked.insert(json["client_id"].toVariant().toLongLong(), json);
+        if (!m_sessionReady || !isConnected())
+            return;
+    }
+
     if (!isConnected()) {
         emit error("未连接到服务器");
         return;
     }
-
-    QJsonDocument doc(json);
-    QByteArray data = doc.toJson(QJsonDocument::Compact);
-    QByteArray packet;
-    QDataStream stream(&packet, QIODevice::WriteOnly);
-    stream << static_cast<quint32>(data.size());
-    packet.append(data);
-    m_clientSocket->write(packet);
+    m_clientSocket->write(WireCodec::frame(WireCodec::encode(json, m_encoding)));
 }
 
 void ChatClient::onReadyRead()
 {
-    QDataStream stream(m_clientSocket);
-    stream.setVersion(QDataStream::Qt_5_15);
-
-    while (true) {
-        if (static_cast<quint32>(m_buffer.size()) < sizeof(quint32)) {
-            if (m_clientSocket->bytesAvailable() < static_cast<qint64>(sizeof(quint32))) {
-                break;
-            }
-            m_buffer.append(m_clientSocket->read(static_cast<qint64>(sizeof(quint32)) - static_cast<qint64>(m_buffer.size())));
-        }
-
-        quint32 messageSize;
-        QDataStream sizeStream(m_buffer);
-        sizeStream >> messageSize;
-
-        if (static_cast<quint32>(m_buffer.size()) < sizeof(quint32) + messageSize) {
-            qint64 remaining = static_cast<qint64>(messageSize) - (static_cast<qint64>(m_buffer.size()) - static_cast<qint64>(sizeof(quint32)));
-            if (m_clientSocket->bytesAvailable() < remaining) {
-                break;
-            }
-            m_buffer.append(m_clientSocket->read(remaining));
-        }
-
-        QByteArray jsonData = m_buffer.mid(sizeof(quint32), messageSize);
-        m_buffer.remove(0, sizeof(quint32) + messageSize);
-
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(jsonData, &error);
-        if (error.error == QJsonParseError::NoError && doc.isObject()) {
-            QJsonObject obj = doc.object();
-            if (obj["type"].toString() == "login_success") {
+    m_decoder.readFrom(m_clientSocket);
+
+    QByteArray payload;
+    QJsonObject obj;
+    while (m_decoder.nextFrame(&payload)) {
+        if (WireCodec::decode(payload, &obj)) {
+            QString type = obj["type"].toString();
+            if (type == "login_success" || type == "bootstrap") {
+                m_username = obj["username"].toString();
+                m_sessionReady = true;
+            } else if (type == "resume_success") {
                 m_username = obj["username"].toString();
+                m_sessionReady = true;
+                // 断线前没收到ack的和断线期间发的消息按顺序重发。ack丢失而服务器已保存的消息
+                // 由服务器按client_id识别，只回原来的ack，不会重复保存和转发
+                for (const QJsonObject &pending : qAsConst(m_unacked)) {
+                    m_clientSocket->write(WireCodec::frame(WireCodec::encode(pending, m_encoding)));
+                }
+            } else if (type == "send_failed" && obj.contains("client_id")) {
+                qint64 clientId = obj["client_id"].toVariant().toLongLong();
+                if (m_unacked.remove(clientId) > 0) {
+                    emit messageFailed(clientId, obj["message"].toString());
+                }
+                continue;
+            } else if (type == "ack") {
+                // 服务器合并发送的确认
+                const QJsonArray acks = obj["acks"].toArray();
+                for (const QJsonValue &value : acks) {
+                    QJsonObject ack = value.toObject();
+                    qint64 clientId = ack["client_id"].toVariant().toLongLong();
+                    m_unacked.remove(clientId);
+                    emit messageAcknowledged(clientId, ack["server_id"].toVariant().toLongLong(),
+                                             ack["timestamp"].toString());
+                }
+                continue;
+            } else if (type == "hello_ack") {
+                // 服务器已确认，之后发出的帧使用协商好的编码
+                WireCodec::encodingFromName(obj["encoding"].toString(), &m_encoding);
             }
             emit jsonReceived(obj);
         }
     }
+
+    if (m_decoder.hasError()) {
+        emit error("收到的数据帧过大，连接已断开");
+        m_clientSocket->abort();
+    }
 }
 
 void ChatClient::onConnected()
 {
+    // 先用JSON发送编码协商，旧服务器会忽略这条消息
+    if (m_preferCbor) {
+        QJsonObject hello;
+        hello["type"] = "hello";
+        hello["encodings"] = QJsonArray{ "cbor", "json" };
+        sendJson(hello);
+    }
     emit connected();
 }
 
+void ChatClient::failPendingMessages(const QString &reason)
+{
+    const QList<qint64> clientIds = m_unacked.keys();
+    m_unacked.clear();
+    for (qint64 clientId : clientIds) {
+        emit messageFailed(clientId, reason);
+    }
+}
+
 void ChatClient::onDisconnected()
 {
+    m_sessionReady = false;
     m_username.clear();
+    m_decoder.reset();
+    m_encoding = WireCodec::Json;
     emit disconnected();
 }
 
@@ -7,6 +7,9 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QThread>
+#include <QMap>
+#include "wirecodec.h"
+#include "framedecoder.h"
 
 class ChatClient : public QObject
 {
@@ -17,14 +20,26 @@ public:
     ~ChatClient();
 
     void connectToServer(const QHostAddress &address, quint16 port);
+    // 用上一次的地址和端口重新连接
+    void reconnectToServer();
     void disconnectFromServer();
     bool isConnected() const;
     QString getUsername() const { return m_username; }
+    // 连接时是否向服务器请求CBOR编码，服务器不支持时自动保持JSON
+    void setPreferCbor(bool prefer) { m_preferCbor = prefer; }
+    WireCodec::Encoding encoding() const { return m_encoding; }
+    // 聊天消息的客户端编号，服务器用ack确认，不再回显整条消息
+    qint64 nextClientId() { return ++m_lastClientId; }
+    int pendingAckCount() const { return m_unacked.size(); }
+    // 放弃所有未确认的消息（会话无法恢复时），逐条发出messageFailed
+    void failPendingMessages(const QString &reason);
 
 signals:
     void connected();
     void disconnected();
     void jsonReceived(const QJsonObject &docObj);
+    void messageAcknowledged(qint64 clientId, qint64 serverId, const QString &timestamp);
+    void messageFailed(qint64 clientId, const QString &reason);
     void error(const QString &errorString);
 
 public slots:
@@ -39,7 +54,15 @@ private slots:
 private:
     QTcpSocket *m_clientSocket;
     QString m_username;
-    QByteArray m_buffer;
+    QHostAddress m_serverAddress;
+    quint16 m_serverPort;
+    FrameDecoder m_decoder;
+    WireCodec::Encoding m_encoding;
+    bool m_preferCbor;
+    qint64 m_lastClientId;
+    bool m_sessionReady;  // 已登录或已恢复会话，聊天消息可以直接发出
+    // 尚未收到ack的聊天消息，按client_id有序；断线期间发的消息也先放在这里，恢复会话后按顺序重发
+    QMap<qint64, QJsonObject> m_unacked;
 };
 
 #endif // CHATCLIENT_H
@@ -3,273 +3,852 @@
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QSharedPointer>
 
 ChatServer::ChatServer(Database *db, QObject *parent)
     : QTcpServer(parent)
+    , m_presenceBatcher(new PresenceBatcher(200, this))
+    , m_unknownMessages(0)
     , m_database(db)
+    , m_ioThreads(new IoThreadPool(0, this))
+    , m_outboundDropMark(1024 * 1024)
+    , m_outboundDisconnectMark(8 * 1024 * 1024)
+    , m_messageStore(new MessageStore(db->databasePath(), this))
+    , m_loginService(new LoginService(db->databasePath(), this))
+    , m_readPool(new DbReadPool(db->databasePath(), 0, this))
+    , m_ackFlushScheduled(false)
+    , m_authTickets(0)
+    , m_recentSendsSweepMs(0)
+    , m_metricsServer(nullptr)
 {
+    // 跨线程的排队信号需要注册参数类型
+    qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketError");
+    qRegisterMetaType<RelayMessage>("RelayMessage");
+
+    MetricsRegistry *metrics = MetricsRegistry::global();
+    m_metrics.unknownMessages = metrics->counter("chat_unknown_messages_total", "Messages with an unknown type");
+    m_metrics.connectionsAccepted = metrics->counter("chat_connections_accepted_total", "Accepted TCP connections");
+    m_metrics.connections = metrics->gauge("chat_connections", "Open client connections");
+    m_metrics.sessions = metrics->gauge("chat_sessions", "Logged-in connections");
+    m_metrics.onlineUsers = metrics->gauge("chat_online_users", "Users with at least one session");
+    m_metrics.loginQueueDepth = metrics->gauge("chat_login_queue_depth", "Credential checks waiting for a thread");
+    m_metrics.loginActive = metrics->gauge("chat_login_active", "Credential checks in progress");
+    m_metrics.storePending = metrics->gauge("chat_message_store_pending", "Messages queued or being written");
+    m_metrics.privateFanout = metrics->histogram("chat_fanout_connections", "Connections a message was sent to",
+                                                 MetricHistogram::sizeBounds(), 1.0, "type=\"private\"");
+    m_metrics.groupFanout = metrics->histogram("chat_fanout_connections", "Connections a message was sent to",
+                                               MetricHistogram::sizeBounds(), 1.0, "type=\"group\"");
+    m_metrics.eventLoopLag = metrics->histogram("chat_event_loop_lag_seconds",
+                                                "Delay of the server thread's sampling timer beyond its interval",
+                                                MetricHistogram::latencyBounds(), 1e-9);
+
+    registerHandlers();
+    m_loginService->setWriter(m_messageStore);
+
+    m_groupIndex.load(m_database->getAllGroupMemberships());
+
+    connect(m_presenceBatcher, &PresenceBatcher::batchReady, this,
+            [this](quint32 recipientId, const QJsonArray &changes) {
+        const QVector<ServerWorker*> *workers = m_sessions.sessions(recipientId);
+        if (!workers)
+            return;
+        QJsonObject batch;
+        batch["type"] = "presence_batch";
+        batch["changes"] = changes;
+        FramedMessage frame = FramedMessage::fromJson(batch);
+        for (ServerWorker *worker : *workers) {
+            worker->sendFrame(frame, ServerWorker::LowPriority);
+        }
+    });
+
+    // 写线程插入的行依赖新的会话列，必须先完成结构升级；旧消息由写线程在后台回填
+    m_database->migrateMessagesSchema(false);
+    if (!m_messageStore->start()) {
+        // 聊天消息会被拒绝而不是静默丢失；无界面服务器据此拒绝启动
+        qCritical() << "消息写线程启动失败";
+    }
+
+    m_metricsTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_metricsTimer, &QTimer::timeout, this, &ChatServer::sampleMetrics);
+    m_metricsTimer.start(MetricsSampleIntervalMs);
+    m_metricsClock.start();
 }
 
 ChatServer::~ChatServer()
 {
     stopServer();
+    m_ioThreads->stop();
+    // 子对象按创建顺序析构，MessageStore会先于线程池被删除；而线程池析构时等待的任务
+    // 还会调用store->flush()并访问this，所以先在这里排空两个线程池，再停写线程
+    delete m_readPool;
+    m_readPool = nullptr;
+    delete m_loginService;
+    m_loginService = nullptr;
+    m_messageStore->stop();
 }
 
-void ChatServer::incomingConnection(qintptr socketDescriptor)
+void ChatServer::setIoThreadCount(int count)
 {
-    ServerWorker *worker = new ServerWorker(this);
-    if (!worker->setSocketDescriptor(socketDescriptor)) {
-        worker->deleteLater();
-        return;
+    IoThreadPool::Policy policy = m_ioThreads->policy();
+    delete m_ioThreads;
+    m_ioThreads = new IoThreadPool(count, this);
+    m_ioThreads->setPolicy(policy);
+}
+
+void ChatServer::setLoadBalancePolicy(IoThreadPool::Policy policy)
+{
+    m_ioThreads->setPolicy(policy);
+}
+
+void ChatServer::setOutboundLimits(qint64 dropMark, qint64 disconnectMark)
+{
+    m_outboundDropMark = dropMark;
+    m_outboundDisconnectMark = disconnectMark;
+}
+
+bool ChatServer::startMetricsServer(quint16 port, const QHostAddress &address)
+{
+    if (!m_metricsServer) {
+        m_metricsServer = new MetricsServer(MetricsRegistry::global(), this);
+    }
+    if (m_metricsServer->isListening()) {
+        m_metricsServer->close();
     }
+    if (!m_metricsServer->listen(address, port)) {
+        emit logMessage(QString("指标端口监听失败: %1").arg(m_metricsServer->errorString()));
+        return false;
+    }
+    emit logMessage(QString("指标端口: http://%1:%2/metrics")
+                    .arg(address.toString()).arg(m_metricsServer->serverPort()));
+    return true;
+}
+
+void ChatServer::sampleMetrics()
+{
+    // 定时器理应每个间隔触发一次，晚到的部分就是本线程事件循环的排队延迟
+    qint64 elapsedNs = m_metricsClock.nsecsElapsed();
+    m_metricsClock.restart();
+    m_metrics.eventLoopLag->observe(qMax(Q_INT64_C(0), elapsedNs - MetricsSampleIntervalMs * Q_INT64_C(1000000)));
+
+    m_metrics.sessions->set(m_sessions.sessionCount());
+    m_metrics.onlineUsers->set(m_sessions.onlineUserCount());
+    m_metrics.loginQueueDepth->set(m_loginService->queueDepth());
+    m_metrics.loginActive->set(m_loginService->activeCount());
+    m_metrics.storePending->set(m_messageStore->pendingCount());
+}
+
+void ChatServer::incomingConnection(qintptr socketDescriptor)
+{
+    // worker在I/O线程中读写socket，信号以排队方式回到本线程处理
+    ServerWorker *worker = new ServerWorker;
+    worker->setOutboundLimits(m_outboundDropMark, m_outboundDisconnectMark);
 
     connect(worker, &ServerWorker::jsonReceived, this, &ChatServer::jsonReceived);
+    connect(worker, &ServerWorker::relayReceived, this, &ChatServer::relayReceived);
     connect(worker, &ServerWorker::disconnectedFromClient, this, [this, worker]() {
+        m_metrics.connections->add(-1);
         onUserDisconnected(worker);
     });
     connect(worker, &ServerWorker::error, this, [this](QAbstractSocket::SocketError socketError) {
         emit logMessage(QString("Socket错误: %1").arg(socketError));
     });
 
-    emit logMessage(QString("新客户端连接: %1").arg(socketDescriptor));
+    int threadIndex = m_ioThreads->assign(worker);
+    m_metrics.connectionsAccepted->increment();
+    m_metrics.connections->add(1);
+
+    // socket必须在它所属的线程中创建底层通知器
+    QMetaObject::invokeMethod(worker, [worker, socketDescriptor]() {
+        if (!worker->setSocketDescriptor(socketDescriptor)) {
+            worker->deleteLater();
+        }
+    }, Qt::QueuedConnection);
+
+    emit logMessage(QString("新客户端连接: %1 (I/O线程 %2)").arg(socketDescriptor).arg(threadIndex));
 }
 
 void ChatServer::stopServer()
 {
-    for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
-        it.value()->disconnectFromClient();
+    const QVector<ServerWorker*> workers = m_sessions.allSessions();
+    for (ServerWorker *worker : workers) {
+        worker->disconnectFromClient();
     }
-    m_clients.clear();
+    m_sessions.clear();
     close();
 }
 
-void ChatServer::jsonReceived(ServerWorker *sender, const QJsonObject &docObj)
+void ChatServer::registerHandlers()
 {
-    QString type = docObj["type"].toString();
+    registerHandler("hello", &ChatServer::handleHello);
+    registerHandler("login", &ChatServer::handleLogin);
+    registerHandler("resume", &ChatServer::handleResume);
+    registerHandler("offline_ack", &ChatServer::handleOfflineAck);
+    registerHandler("register", &ChatServer::handleRegister);
+    registerHandler("private_message", &ChatServer::handlePrivateMessage);
+    registerHandler("group_message", &ChatServer::handleGroupMessage);
+    registerHandler("add_contact", &ChatServer::handleAddContact);
+    registerHandler("create_group", &ChatServer::handleCreateGroup);
+    registerHandler("join_group", &ChatServer::handleJoinGroup);
+    registerHandler("add_group_members", &ChatServer::handleAddGroupMembers);
+    registerHandler("get_history", &ChatServer::handleGetHistory);
+}
 
-    if (type == "login") {
-        QString username = docObj["username"].toString();
-        QString password = docObj["password"].toString();
+void ChatServer::registerHandler(const QString &type, Handler handler)
+{
+    auto it = m_typeIds.constFind(type);
+    if (it != m_typeIds.constEnd()) {
+        m_handlers[it.value()].handler = handler;
+        return;
+    }
 
-        if (m_database->authenticateUser(username, password)) {
-            sender->setUsername(username);
-            m_clients[username] = sender;
+    DispatchEntry entry;
+    entry.type = type;
+    entry.handler = handler;
+    const QString labels = QString("type=\"%1\"").arg(type);
+    entry.received = MetricsRegistry::global()->counter("chat_messages_received_total",
+                                                        "Client messages handled, by type", labels);
+    entry.traceName = Tracer::intern("dispatch:" + type);
+    entry.handleTime = MetricsRegistry::global()->histogram("chat_handler_seconds",
+                                                            "Time spent in the message handler, by type",
+                                                            MetricHistogram::latencyBounds(), 1e-9, labels);
+    m_typeIds.insert(type, m_handlers.size());
+    m_handlers.append(entry);
+}
 
-            m_database->updateUserStatus(username, true);
+QVector<ChatServer::DispatchStats> ChatServer::dispatchStats() const
+{
+    QVector<DispatchStats> stats;
+    stats.reserve(m_handlers.size());
+    for (const DispatchEntry &entry : m_handlers) {
+        DispatchStats item;
+        item.type = entry.type;
+        item.calls = entry.calls;
+        item.totalNs = entry.totalNs;
+        stats.append(item);
+    }
+    return stats;
+}
 
-            QJsonObject response;
-            response["type"] = "login_success";
-            response["username"] = username;
-            response["userInfo"] = m_database->getUserInfo(username);
-            sender->sendJson(response);
+void ChatServer::jsonReceived(ServerWorker *sender, const QJsonObject &docObj, quint64 traceId)
+{
+    // 按消息类型查表分发，同时记录每种类型的调用次数和耗时
+    auto it = m_typeIds.constFind(docObj["type"].toString());
+    if (it == m_typeIds.constEnd()) {
+        ++m_unknownMessages;
+        m_metrics.unknownMessages->increment();
+        return;
+    }
 
-            // 发送联系人列表
-            QJsonObject contactsMsg;
-            contactsMsg["type"] = "contacts_list";
-            contactsMsg["contacts"] = m_database->getContacts(username);
-            sender->sendJson(contactsMsg);
-
-            // 发送群组列表
-            QJsonObject groupsMsg;
-            groupsMsg["type"] = "groups_list";
-            groupsMsg["groups"] = m_database->getUserGroups(username);
-            sender->sendJson(groupsMsg);
-
-            // 发送离线消息
-            QJsonArray offlineMessages = m_database->getOfflineMessages(username);
-            if (offlineMessages.size() > 0) {
-                QJsonObject offlineMsg;
-                offlineMsg["type"] = "offline_messages";
-                offlineMsg["messages"] = offlineMessages;
-                sender->sendJson(offlineMsg);
-                
-                // 标记这些离线消息为已读，避免下次登录重复显示
-                for (const QJsonValue &value : offlineMessages) {
-                    QJsonObject msg = value.toObject();
-                    qint64 messageId = msg["id"].toVariant().toLongLong();
-                    m_database->markMessageAsRead(messageId);
-                }
-            }
+    const int typeId = it.value();
+    // 处理过程中生成的帧和入库的消息都继承这个trace id
+    Tracer::Scope traceScope(traceId);
+    TraceSpan span(m_handlers[typeId].traceName, traceId);
+    QElapsedTimer timer;
+    timer.start();
+    (this->*m_handlers[typeId].handler)(sender, docObj);
+    recordDispatch(typeId, timer.nsecsElapsed());
+}
+
+void ChatServer::recordDispatch(int typeId, qint64 elapsedNs)
+{
+    DispatchEntry &entry = m_handlers[typeId];
+    ++entry.calls;
+    entry.totalNs += elapsedNs;
+    entry.received->increment();
+    entry.handleTime->observe(elapsedNs);
+}
+
+void ChatServer::handleHello(ServerWorker *sender, const QJsonObject &docObj)
+{
+    // 编码协商：客户端按偏好顺序列出支持的编码
+    WireCodec::Encoding encoding = WireCodec::Json;
+    const QJsonArray encodings = docObj["encodings"].toArray();
+    for (const QJsonValue &value : encodings) {
+        if (WireCodec::encodingFromName(value.toString(), &encoding))
+            break;
+    }
+
+    // 确认消息仍用JSON发出，之后再切换
+    QJsonObject response;
+    response["type"] = "hello_ack";
+    response["encoding"] = WireCodec::encodingName(encoding);
+    sender->sendJson(response);
+    sender->setEncoding(encoding);
+}
+
+void ChatServer::handleLogin(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString username = docObj["username"].toString();
+    QString password = docObj["password"].toString();
+
+    // 同一连接上一次校验还没返回时忽略重复请求
+    if (m_pendingAuth.contains(sender))
+        return;
+
+    // 会话按用户id登记，已登录的连接换用户会在旧用户下留下悬空的登记
+    if (!sender->getUsername().isEmpty()) {
+        QJsonObject response;
+        response["type"] = "login_failed";
+        response["message"] = "该连接已经登录";
+        sender->sendJson(response);
+        return;
+    }
+
+    // 客户端声明支持时，初始数据合并成一个bootstrap帧，否则按原来的四个帧分别发送
+    bool combined = docObj["bootstrap"].toBool();
+
+    quint64 ticket = ++m_authTickets;
+    bool queued = m_loginService->authenticate(username, password,
+                                               [this, sender, ticket, username, combined](bool ok, quint32 userId) {
+        completeLogin(sender, ticket, username, combined, ok, userId);
+    });
+    if (queued) {
+        m_pendingAuth.insert(sender, ticket);
+        return;
+    }
+
+    QJsonObject response;
+    response["type"] = "login_failed";
+    response["message"] = "服务器繁忙，请稍后重试";
+    sender->sendJson(response);
+}
+
+void ChatServer::completeLogin(ServerWorker *sender, quint64 ticket, const QString &username, bool combined,
+                               bool ok, quint32 userId)
+{
+    // 校验期间连接已断开（worker地址可能已被新连接复用，所以还要比对ticket）
+    if (m_pendingAuth.value(sender) != ticket)
+        return;
+    m_pendingAuth.remove(sender);
+
+    if (ok) {
+        openSession(sender, userId, username);
+        loadBootstrap(sender, userId, username, combined);
+
+        emit logMessage(QString("用户登录: %1").arg(username));
+        emit userConnected(username);
+    } else {
+        QJsonObject response;
+        response["type"] = "login_failed";
+        response["message"] = "用户名或密码错误";
+        sender->sendJson(response);
+        emit logMessage(QString("登录失败: %1").arg(username));
+    }
+}
+
+void ChatServer::handleResume(ServerWorker *sender, const QJsonObject &docObj)
+{
+    if (!sender->getUsername().isEmpty() || m_pendingAuth.contains(sender))
+        return;
+
+    // 令牌里的id还要与当前用户表一致，防止账号被删除后重建
+    quint32 userId = 0;
+    QString username;
+    if (!m_sessionTokens.verify(docObj["token"].toString(), &userId, &username)
+            || resolveUserId(username) != userId) {
+        QJsonObject response;
+        response["type"] = "resume_failed";
+        response["message"] = "会话已过期，请重新登录";
+        sender->sendJson(response);
+        return;
+    }
+
+    openSession(sender, userId, username);
+
+    QJsonObject response;
+    response["type"] = "resume_success";
+    response["username"] = username;
+    response["token"] = m_sessionTokens.issue(userId, username);
+    sender->sendJson(response);
+
+    // 只补发客户端最后收到的消息之后的部分；客户端没有记录时退回离线消息
+    qint64 lastMessageId = docObj["last_message_id"].toVariant().toLongLong();
+    if (lastMessageId > 0) {
+        sendDeltaPage(sender, lastMessageId, true);
+    } else {
+        sendOfflinePage(sender, 0, true);
+    }
+
+    emit logMessage(QString("用户恢复会话: %1").arg(username));
+    emit userConnected(username);
+}
+
+void ChatServer::handleOfflineAck(ServerWorker *sender, const QJsonObject &docObj)
+{
+    // 客户端确认收到一页离线消息：整页一次标记已读，再发送下一页
+    auto it = m_offlineCursors.find(sender);
+    if (it == m_offlineCursors.end())
+        return;
 
-            emit logMessage(QString("用户登录: %1").arg(username));
-            emit userConnected(username);
+    qint64 cursor = docObj["cursor"].toVariant().toLongLong();
+    if (cursor != it->lastId)
+        return;
 
-            // 通知其他用户
-            QJsonObject notifyMsg;
-            notifyMsg["type"] = "user_online";
-            notifyMsg["username"] = username;
-            broadcastToAll(notifyMsg, sender);
+    // 与消息写入共用写线程的连接；写线程没有运行时才退回主连接
+    QList<qint64> ids = it->pendingIds;
+    bool posted = m_messageStore->post([ids](QSqlDatabase &db) {
+        return Database::markMessagesAsRead(db, ids);
+    });
+    if (!posted) {
+        m_database->markMessagesAsRead(ids);
+    }
+    bool hasMore = it->hasMore;
+    bool delta = it->delta;
+    m_offlineCursors.erase(it);
+
+    if (hasMore) {
+        if (delta) {
+            sendDeltaPage(sender, cursor);
         } else {
-            QJsonObject response;
-            response["type"] = "login_failed";
-            response["message"] = "用户名或密码错误";
-            sender->sendJson(response);
-            emit logMessage(QString("登录失败: %1").arg(username));
+            sendOfflinePage(sender, cursor);
         }
     }
-    else if (type == "register") {
-        QString username = docObj["username"].toString();
-        QString password = docObj["password"].toString();
-        QString nickname = docObj["nickname"].toString();
+}
 
-        if (m_database->createUser(username, password, nickname)) {
-            QJsonObject response;
-            response["type"] = "register_success";
-            response["message"] = "注册成功";
-            sender->sendJson(response);
-            emit logMessage(QString("新用户注册: %1").arg(username));
-        } else {
-            QJsonObject response;
-            response["type"] = "register_failed";
-            response["message"] = "用户名已存在";
-            sender->sendJson(response);
+void ChatServer::handleRegister(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString username = docObj["username"].toString();
+    QString password = docObj["password"].toString();
+    QString nickname = docObj["nickname"].toString();
+
+    if (m_pendingAuth.contains(sender))
+        return;
+
+    quint64 ticket = ++m_authTickets;
+    bool queued = m_loginService->createUser(username, password, nickname, [this, sender, ticket, username](bool ok) {
+        completeRegister(sender, ticket, username, ok);
+    });
+    if (queued) {
+        m_pendingAuth.insert(sender, ticket);
+        return;
+    }
+
+    QJsonObject response;
+    response["type"] = "register_failed";
+    response["message"] = "服务器繁忙，请稍后重试";
+    sender->sendJson(response);
+}
+
+void ChatServer::completeRegister(ServerWorker *sender, quint64 ticket, const QString &username, bool ok)
+{
+    if (m_pendingAuth.value(sender) != ticket)
+        return;
+    m_pendingAuth.remove(sender);
+
+    if (ok) {
+        QJsonObject response;
+        response["type"] = "register_success";
+        response["message"] = "注册成功";
+        sender->sendJson(response);
+        emit logMessage(QString("新用户注册: %1").arg(username));
+    } else {
+        QJsonObject response;
+        response["type"] = "register_failed";
+        response["message"] = "用户名已存在";
+        sender->sendJson(response);
+    }
+}
+
+void ChatServer::relayReceived(ServerWorker *sender, const RelayMessage &message)
+{
+    // 与完整解码的同类消息共用分发统计
+    const bool isPrivate = message.kind == RelayMessage::Private;
+    const int typeId = m_typeIds.value(isPrivate ? "private_message" : "group_message", -1);
+
+    Tracer::Scope traceScope(message.traceId);
+    TraceSpan span(typeId >= 0 ? m_handlers[typeId].traceName : "dispatch:relay", message.traceId);
+    QElapsedTimer timer;
+    timer.start();
+    if (isPrivate) {
+        relayPrivateMessage(sender, message);
+    } else {
+        relayGroupMessage(sender, message);
+    }
+
+    if (typeId >= 0) {
+        recordDispatch(typeId, timer.nsecsElapsed());
+    }
+}
+
+void ChatServer::handlePrivateMessage(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString receiver = docObj["receiver"].toString();
+    QString senderUsername = sender->getUsername();
+    QString content = docObj["content"].toString();
+    qint64 clientId = docObj["client_id"].toVariant().toLongLong();
+    if (acknowledgeDuplicate(sender, clientId))
+        return;
+
+    // 放入异步写队列，立即得到消息id，不等待落盘
+    qint64 messageId = m_messageStore->enqueue(senderUsername, receiver, content, "private");
+    if (messageId == 0) {
+        rejectMessage(sender, clientId);
+        return;
+    }
+
+    QJsonObject message;
+    message["type"] = "private_message";
+    message["id"] = messageId;
+    message["sender"] = senderUsername;
+    message["receiver"] = receiver;
+    message["content"] = content;
+    message["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+    FramedMessage frame = FramedMessage::fromJson(message);
+    routePrivateMessage(sender, receiver, frame);
+    confirmToSender(sender, clientId, message, frame);
+}
+
+void ChatServer::relayPrivateMessage(ServerWorker *sender, const RelayMessage &relay)
+{
+    if (acknowledgeDuplicate(sender, relay.clientId))
+        return;
+
+    QString senderUsername = sender->getUsername();
+    qint64 messageId = m_messageStore->enqueueRaw(senderUsername, relay.target, relay.content, "private");
+    if (messageId == 0) {
+        rejectMessage(sender, relay.clientId);
+        return;
+    }
+
+    QJsonObject meta;
+    meta["type"] = "private_message";
+    meta["id"] = messageId;
+    meta["sender"] = senderUsername;
+    meta["receiver"] = relay.target;
+    meta["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+    FramedMessage frame = FramedMessage::fromJsonPayload(RelayFrame::build(meta, relay.content));
+    routePrivateMessage(sender, relay.target, frame);
+    confirmToSender(sender, relay.clientId, meta, frame);
+}
+
+void ChatServer::routePrivateMessage(ServerWorker *sender, const QString &receiver, const FramedMessage &frame)
+{
+    // 如果接收者在线，发给其所有设备；否则留作离线消息
+    TraceSpan span("fanout:private");
+    quint32 receiverId = m_sessions.userId(receiver);
+    int sent = 0;
+    if (receiverId != 0 && receiverId != sender->userId()) {
+        sent += sendToUser(receiverId, frame);
+    }
+
+    // 同步到发送者的其他设备
+    sent += sendToUser(sender->userId(), frame, sender);
+    m_metrics.privateFanout->observe(sent);
+}
+
+void ChatServer::confirmToSender(ServerWorker *sender, qint64 clientId, const QJsonObject &message,
+                                 const FramedMessage &frame)
+{
+    // 旧客户端没有client_id，仍然回显完整消息
+    if (clientId <= 0) {
+        if (message["type"].toString() == "private_message") {
+            sender->sendFrame(frame);
         }
+        return;
+    }
+
+    QJsonObject ack;
+    ack["client_id"] = clientId;
+    ack["server_id"] = message["id"];
+    ack["timestamp"] = message["timestamp"];
+    rememberSend(sender->userId(), clientId, ack);
+    queueAck(sender, ack);
+}
+
+void ChatServer::queueAck(ServerWorker *sender, const QJsonObject &ack)
+{
+    m_pendingAcks[sender].append(ack);
+
+    // 同一轮事件循环里的确认合并成一帧
+    if (!m_ackFlushScheduled) {
+        m_ackFlushScheduled = true;
+        QMetaObject::invokeMethod(this, &ChatServer::flushAcks, Qt::QueuedConnection);
     }
-    else if (type == "private_message") {
-        QString receiver = docObj["receiver"].toString();
-        QString senderUsername = sender->getUsername();
-        QString content = docObj["content"].toString();
+}
+
+void ChatServer::rememberSend(quint32 userId, qint64 clientId, const QJsonObject &ack)
+{
+    RecentSends &recent = m_recentSends[userId];
+    recent.acks.insert(clientId, ack);
+    recent.order.enqueue(clientId);
+    if (recent.order.size() > RecentSendWindow) {
+        recent.acks.remove(recent.order.dequeue());
+    }
+}
 
-        // 保存消息到数据库
-        m_database->saveMessage(senderUsername, receiver, content, "private");
+bool ChatServer::acknowledgeDuplicate(ServerWorker *sender, qint64 clientId)
+{
+    if (clientId <= 0)
+        return false;
 
-        QJsonObject message;
-        message["type"] = "private_message";
-        message["sender"] = senderUsername;
-        message["receiver"] = receiver;
-        message["content"] = content;
-        message["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    auto recent = m_recentSends.constFind(sender->userId());
+    if (recent == m_recentSends.constEnd())
+        return false;
+    auto ack = recent->acks.constFind(clientId);
+    if (ack == recent->acks.constEnd())
+        return false;
+
+    // ack在断线中丢失，客户端恢复会话后重发：不再保存和转发，只把原来的ack再发一次
+    queueAck(sender, ack.value());
+    return true;
+}
+
+void ChatServer::sweepRecentSends()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (now - m_recentSendsSweepMs < RecentSendsSweepIntervalMs)
+        return;
+    m_recentSendsSweepMs = now;
 
-        // 如果接收者在线，直接发送；否则标记为离线消息
-        if (m_clients.contains(receiver)) {
-            sendToUser(receiver, message);
+    for (auto it = m_recentSends.begin(); it != m_recentSends.end();) {
+        if (it->expiresMs != 0 && it->expiresMs < now) {
+            it = m_recentSends.erase(it);
+        } else {
+            ++it;
         }
+    }
+}
 
-        // 也发送给发送者（确认）
-        sender->sendJson(message);
+void ChatServer::flushAcks()
+{
+    m_ackFlushScheduled = false;
+    for (auto it = m_pendingAcks.constBegin(); it != m_pendingAcks.constEnd(); ++it) {
+        QJsonObject batch;
+        batch["type"] = "ack";
+        batch["acks"] = it.value();
+        it.key()->sendJson(batch);
     }
-    else if (type == "group_message") {
-        QString groupName = docObj["group_name"].toString();
-        QString senderUsername = sender->getUsername();
-        QString content = docObj["content"].toString();
+    m_pendingAcks.clear();
+}
 
-        // 保存消息到数据库
-        m_database->saveMessage(senderUsername, "", content, "group", groupName);
+void ChatServer::rejectMessage(ServerWorker *sender, qint64 clientId)
+{
+    QJsonObject response;
+    response["type"] = "send_failed";
+    if (clientId > 0) {
+        response["client_id"] = clientId;
+    }
+    response["message"] = "消息存储不可用，消息未发送";
+    sender->sendJson(response);
+}
 
-        QJsonObject message;
-        message["type"] = "group_message";
-        message["sender"] = senderUsername;
-        message["group_name"] = groupName;
-        message["content"] = content;
-        message["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+void ChatServer::handleGroupMessage(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString groupName = docObj["group_name"].toString();
+    QString senderUsername = sender->getUsername();
+    QString content = docObj["content"].toString();
+    qint64 clientId = docObj["client_id"].toVariant().toLongLong();
+    if (acknowledgeDuplicate(sender, clientId))
+        return;
 
-        sendToGroup(groupName, message, sender);
+    qint64 messageId = m_messageStore->enqueue(senderUsername, "", content, "group", groupName);
+    if (messageId == 0) {
+        rejectMessage(sender, clientId);
+        return;
     }
-    else if (type == "add_contact") {
-        QString contactUsername = docObj["contact_username"].toString();
-        QString username = sender->getUsername();
 
-        if (m_database->addContact(username, contactUsername)) {
-            QJsonObject response;
-            response["type"] = "add_contact_success";
-            response["contact"] = m_database->getUserInfo(contactUsername);
-            sender->sendJson(response);
+    QJsonObject message;
+    message["type"] = "group_message";
+    message["id"] = messageId;
+    message["sender"] = senderUsername;
+    message["group_name"] = groupName;
+    message["content"] = content;
+    message["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
 
-            // 更新联系人列表
-            QJsonObject contactsMsg;
-            contactsMsg["type"] = "contacts_list";
-            contactsMsg["contacts"] = m_database->getContacts(username);
-            sender->sendJson(contactsMsg);
-        } else {
+    FramedMessage frame = FramedMessage::fromJson(message);
+    m_metrics.groupFanout->observe(sendToGroup(groupName, frame, sender));
+    confirmToSender(sender, clientId, message, frame);
+}
+
+void ChatServer::relayGroupMessage(ServerWorker *sender, const RelayMessage &relay)
+{
+    if (acknowledgeDuplicate(sender, relay.clientId))
+        return;
+
+    QString senderUsername = sender->getUsername();
+    qint64 messageId = m_messageStore->enqueueRaw(senderUsername, "", relay.content, "group", relay.target);
+    if (messageId == 0) {
+        rejectMessage(sender, relay.clientId);
+        return;
+    }
+
+    QJsonObject meta;
+    meta["type"] = "group_message";
+    meta["id"] = messageId;
+    meta["sender"] = senderUsername;
+    meta["group_name"] = relay.target;
+    meta["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+    FramedMessage frame = FramedMessage::fromJsonPayload(RelayFrame::build(meta, relay.content));
+    m_metrics.groupFanout->observe(sendToGroup(relay.target, frame, sender));
+    confirmToSender(sender, relay.clientId, meta, frame);
+}
+
+void ChatServer::handleAddContact(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString contactUsername = docObj["contact_username"].toString();
+    QString username = sender->getUsername();
+    quint32 userId = sender->userId();
+
+    postWrite([username, contactUsername](Database &db) {
+        return db.addContact(username, contactUsername);
+    }, [this, sender, userId, username, contactUsername](bool ok) {
+        if (!hasSession(sender, userId))
+            return;
+
+        if (!ok) {
             QJsonObject response;
             response["type"] = "add_contact_failed";
             response["message"] = "添加联系人失败";
             sender->sendJson(response);
+            return;
+        }
+
+        // 之后对方上下线时也要通知这个用户
+        auto watchers = m_presenceWatchers.find(m_sessions.userId(contactUsername));
+        if (watchers != m_presenceWatchers.end()) {
+            watchers->insert(userId);
         }
-    }
-    else if (type == "create_group") {
-        QString groupName = docObj["group_name"].toString();
-        QString creator = sender->getUsername();
 
-        if (m_database->createGroup(groupName, creator)) {
+        // 联系人信息和更新后的联系人列表在只读连接上查询
+        m_readPool->start([this, sender, userId, username, contactUsername](QSqlDatabase &connection) {
+            Database db(connection);
             QJsonObject response;
-            response["type"] = "create_group_success";
-            response["group_name"] = groupName;
-            sender->sendJson(response);
+            response["type"] = "add_contact_success";
+            response["contact"] = db.getUserInfo(contactUsername);
 
-            // 更新群组列表
-            QJsonObject groupsMsg;
-            groupsMsg["type"] = "groups_list";
-            groupsMsg["groups"] = m_database->getUserGroups(creator);
-            sender->sendJson(groupsMsg);
-        } else {
+            QJsonObject contactsMsg;
+            contactsMsg["type"] = "contacts_list";
+            contactsMsg["contacts"] = db.getContacts(username);
+
+            m_readPool->deliver([this, sender, userId, response, contactsMsg]() {
+                if (hasSession(sender, userId)) {
+                    sender->sendJson(response);
+                    sender->sendJson(contactsMsg);
+                }
+            });
+        });
+    });
+}
+
+void ChatServer::handleCreateGroup(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString groupName = docObj["group_name"].toString();
+    QString creator = sender->getUsername();
+    quint32 userId = sender->userId();
+
+    postWrite([groupName, creator](Database &db) {
+        return db.createGroup(groupName, creator);
+    }, [this, sender, userId, groupName, creator](bool ok) {
+        if (!hasSession(sender, userId))
+            return;
+
+        if (!ok) {
             QJsonObject response;
             response["type"] = "create_group_failed";
             response["message"] = "创建群组失败";
             sender->sendJson(response);
+            return;
         }
-    }
-    else if (type == "join_group") {
-        QString groupName = docObj["group_name"].toString();
-        QString username = sender->getUsername();
 
-        if (m_database->addUserToGroup(groupName, username)) {
-            QJsonObject response;
-            response["type"] = "join_group_success";
-            response["group_name"] = groupName;
-            sender->sendJson(response);
+        m_groupIndex.addMember(groupName, userId, true);
 
-            // 更新群组列表
-            QJsonObject groupsMsg;
-            groupsMsg["type"] = "groups_list";
-            groupsMsg["groups"] = m_database->getUserGroups(username);
-            sender->sendJson(groupsMsg);
-        } else {
+        QJsonObject response;
+        response["type"] = "create_group_success";
+        response["group_name"] = groupName;
+        sender->sendJson(response);
+
+        // 更新群组列表
+        sendGroupsList(userId, creator, sender);
+    });
+}
+
+void ChatServer::handleJoinGroup(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString groupName = docObj["group_name"].toString();
+    QString username = sender->getUsername();
+    quint32 userId = sender->userId();
+
+    postWrite([groupName, username](Database &db) {
+        return db.addUserToGroup(groupName, username);
+    }, [this, sender, userId, groupName, username](bool ok) {
+        if (!hasSession(sender, userId))
+            return;
+
+        if (!ok) {
             QJsonObject response;
             response["type"] = "join_group_failed";
             response["message"] = "加入群组失败";
             sender->sendJson(response);
+            return;
         }
-    }
-    else if (type == "add_group_members") {
-        QString groupName = docObj["group_name"].toString();
-        QString inviter = sender->getUsername();
-        QJsonArray members = docObj["members"].toArray();
 
-        QJsonArray addedMembers;
+        m_groupIndex.addMember(groupName, userId, true);
+
+        QJsonObject response;
+        response["type"] = "join_group_success";
+        response["group_name"] = groupName;
+        sender->sendJson(response);
 
+        // 更新群组列表
+        sendGroupsList(userId, username, sender);
+    });
+}
+
+void ChatServer::handleAddGroupMembers(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString groupName = docObj["group_name"].toString();
+    QString inviter = sender->getUsername();
+    quint32 inviterId = sender->userId();
+    QJsonArray members = docObj["members"].toArray();
+
+    // 检查和加入都在写线程上完成，结果（用户名 -> id）回到本线程后再更新索引和通知
+    typedef QVector<QPair<QString, quint32>> AddedMembers;
+    QSharedPointer<AddedMembers> added(new AddedMembers);
+
+    postWrite([groupName, inviter, members, added](Database &db) {
         for (const QJsonValue &val : members) {
             QString memberUsername = val.toString();
             if (memberUsername.isEmpty())
                 continue;
 
             // 必须是邀请人的联系人，且不重复加入
-            if (!m_database->isContact(inviter, memberUsername))
+            if (!db.isContact(inviter, memberUsername))
                 continue;
-            if (m_database->isGroupMember(groupName, memberUsername))
+            if (db.isGroupMember(groupName, memberUsername))
                 continue;
 
-            if (m_database->addUserToGroup(groupName, memberUsername)) {
-                addedMembers.append(memberUsername);
-
-                // 如果该用户在线，通知其被拉入群聊，并更新其群组列表
-                if (m_clients.contains(memberUsername)) {
-                    ServerWorker *worker = m_clients.value(memberUsername);
+            if (db.addUserToGroup(groupName, memberUsername)) {
+                added->append(qMakePair(memberUsername, db.getUserId(memberUsername)));
+            }
+        }
+        return true;
+    }, [this, sender, inviterId, groupName, inviter, added](bool) {
+        QJsonArray addedMembers;
+        for (const QPair<QString, quint32> &member : qAsConst(*added)) {
+            addedMembers.append(member.first);
+            quint32 memberId = member.second;
+            bool online = m_sessions.isOnline(memberId);
+            m_groupIndex.addMember(groupName, memberId, online);
 
-                    QJsonObject notify;
-                    notify["type"] = "added_to_group";
-                    notify["group_name"] = groupName;
-                    notify["inviter"] = inviter;
-                    worker->sendJson(notify);
+            // 如果该用户在线，通知其被拉入群聊，并更新其群组列表
+            if (online) {
+                QJsonObject notify;
+                notify["type"] = "added_to_group";
+                notify["group_name"] = groupName;
+                notify["inviter"] = inviter;
+                sendToUser(memberId, FramedMessage::fromJson(notify));
 
-                    QJsonObject groupsMsg;
-                    groupsMsg["type"] = "groups_list";
-                    groupsMsg["groups"] = m_database->getUserGroups(memberUsername);
-                    worker->sendJson(groupsMsg);
-                }
+                sendGroupsList(memberId, member.first);
             }
         }
 
+        if (!hasSession(sender, inviterId))
+            return;
+
         // 给邀请人返回结果，并刷新其群组列表
         QJsonObject response;
         response["type"] = "add_group_members_result";
@@ -277,73 +856,399 @@ void ChatServer::jsonReceived(ServerWorker *sender, const QJsonObject &docObj)
         response["members"] = addedMembers;
         sender->sendJson(response);
 
+        sendGroupsList(inviterId, inviter, sender);
+    });
+}
+
+void ChatServer::postWrite(const std::function<bool(Database &db)> &write, const std::function<void(bool ok)> &done)
+{
+    bool posted = m_messageStore->post([this, write, done](QSqlDatabase &connection) {
+        Database db(connection);
+        bool ok = write(db);
+        QMetaObject::invokeMethod(this, [done, ok]() {
+            done(ok);
+        }, Qt::QueuedConnection);
+        return ok;
+    });
+    if (!posted) {
+        done(false);
+    }
+}
+
+void ChatServer::sendGroupsList(quint32 userId, const QString &username, ServerWorker *worker)
+{
+    m_readPool->start([this, userId, username, worker](QSqlDatabase &connection) {
+        Database db(connection);
         QJsonObject groupsMsg;
         groupsMsg["type"] = "groups_list";
-        groupsMsg["groups"] = m_database->getUserGroups(inviter);
-        sender->sendJson(groupsMsg);
-    }
-    else if (type == "get_history") {
-        QString target = docObj["target"].toString();
-        QString messageType = docObj["message_type"].toString();
-        QString username = sender->getUsername();
+        groupsMsg["groups"] = db.getUserGroups(username);
+        FramedMessage frame = FramedMessage::fromJson(groupsMsg);
+        m_readPool->deliver([this, userId, worker, frame]() {
+            if (!worker) {
+                sendToUser(userId, frame);
+            } else if (hasSession(worker, userId)) {
+                worker->sendFrame(frame);
+            }
+        });
+    });
+}
+
+void ChatServer::handleGetHistory(ServerWorker *sender, const QJsonObject &docObj)
+{
+    QString target = docObj["target"].toString();
+    QString messageType = docObj["message_type"].toString();
+    QString username = sender->getUsername();
 
-        QJsonArray messages = m_database->getMessages(username, target, messageType);
+    // 按消息id做keyset分页：before_id向前翻页，after_id取新消息，都不带则取最新一页
+    qint64 beforeId = docObj["before_id"].toVariant().toLongLong();
+    qint64 afterId = docObj["after_id"].toVariant().toLongLong();
+    int pageSize = docObj["page_size"].toInt(DefaultHistoryPageSize);
+    pageSize = qBound(1, pageSize, MaxHistoryPageSize);
+
+    // 在只读连接上查询，翻聊天记录不再阻塞事件循环和消息转发；
+    // 等待写线程提交也放在池线程里做
+    quint32 userId = sender->userId();
+    MessageStore *store = m_messageStore;
+    m_readPool->start([this, store, sender, userId, username, target, messageType,
+                       beforeId, afterId, pageSize](QSqlDatabase &connection) {
+        store->flush();
+        Database db(connection);
+        bool hasMore = false;
+        QJsonArray messages = db.getMessagesPage(username, target, messageType,
+                                                 beforeId, afterId, pageSize, &hasMore);
 
         QJsonObject response;
         response["type"] = "history_messages";
         response["target"] = target;
         response["message_type"] = messageType;
         response["messages"] = messages;
-        sender->sendJson(response);
-    }
+        response["has_more"] = hasMore;
+        m_readPool->deliver([this, sender, userId, response]() {
+            if (hasSession(sender, userId)) {
+                sender->sendJson(response);
+            }
+        });
+    });
 }
 
 void ChatServer::onUserDisconnected(ServerWorker *sender)
 {
+    m_pendingAuth.remove(sender);
+    m_pendingAcks.remove(sender);
+
     QString username = sender->getUsername();
     if (!username.isEmpty()) {
-        m_clients.remove(username);
-        m_database->updateUserStatus(username, false);
+        quint32 userId = sender->userId();
+        m_offlineCursors.remove(sender);
 
-        QJsonObject notifyMsg;
-        notifyMsg["type"] = "user_offline";
-        notifyMsg["username"] = username;
-        broadcastToAll(notifyMsg, sender);
+        // 最后一个设备下线才算用户离线
+        if (m_sessions.remove(userId, sender) == 0) {
+            m_groupIndex.userOffline(userId);
+            postUserStatus(username, false);
+
+            // 令牌过期前仍可能恢复会话并重发，去重窗口保留到那时
+            auto recent = m_recentSends.find(userId);
+            if (recent != m_recentSends.end()) {
+                recent->expiresMs = QDateTime::currentMSecsSinceEpoch()
+                        + m_sessionTokens.lifetime() * Q_INT64_C(1000);
+            }
+
+            m_presenceBatcher->removeRecipient(userId);
+            notifyPresence(userId, username, false);
+            m_presenceWatchers.remove(userId);
+        }
 
         emit logMessage(QString("用户断开连接: %1").arg(username));
         emit userDisconnected(username);
     }
+    sweepRecentSends();
 
     sender->deleteLater();
 }
 
-void ChatServer::broadcastToAll(const QJsonObject &message, ServerWorker *exclude)
+quint32 ChatServer::openSession(ServerWorker *sender, quint32 userId, const QString &username)
 {
-    for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
-        if (it.value() != exclude) {
-            it.value()->sendJson(message);
+    // 用户名只在登录时换成id，之后的路由和索引都按id进行
+    m_sessions.intern(username, userId);
+    sender->setUsername(username);
+    sender->setUserId(userId);
+
+    // 同一用户的其他设备已在线时，不重复更新状态和通知上线
+    if (m_sessions.add(userId, sender) == 1) {
+        m_groupIndex.userOnline(userId);
+        postUserStatus(username, true);
+
+        auto recent = m_recentSends.find(userId);
+        if (recent != m_recentSends.end()) {
+            recent->expiresMs = 0;
         }
+
+        // 把该用户加为联系人的用户在只读线程池上查询，期间新加的联系人先记在空集合里
+        m_presenceWatchers.insert(userId, QSet<quint32>());
+        m_readPool->start([this, userId, username](QSqlDatabase &connection) {
+            Database db(connection);
+            const QList<quint32> owners = db.getContactOwners(userId);
+            m_readPool->deliver([this, userId, username, owners]() {
+                // 查询期间用户已下线
+                auto watchers = m_presenceWatchers.find(userId);
+                if (watchers == m_presenceWatchers.end())
+                    return;
+                watchers->unite(QSet<quint32>(owners.begin(), owners.end()));
+                // 通知关心该用户的在线用户
+                notifyPresence(userId, username, true);
+            });
+        });
     }
+    return userId;
 }
 
-void ChatServer::sendToUser(const QString &username, const QJsonObject &message)
+void ChatServer::postUserStatus(const QString &username, bool online)
 {
-    if (m_clients.contains(username)) {
-        m_clients[username]->sendJson(message);
-    }
+    // 在写线程上更新，不在事件循环上和写连接争锁
+    m_messageStore->post([username, online](QSqlDatabase &connection) {
+        Database db(connection);
+        return db.updateUserStatus(username, online);
+    });
 }
 
-void ChatServer::sendToGroup(const QString &groupName, const QJsonObject &message, ServerWorker *exclude)
+void ChatServer::sendOfflinePage(ServerWorker *worker, qint64 afterId, bool flushStore)
 {
-    QJsonArray members = m_database->getGroupMembers(groupName);
-    for (const QJsonValue &value : members) {
-        QJsonObject member = value.toObject();
-        QString username = member["username"].toString();
-        if (m_clients.contains(username)) {
-            ServerWorker *worker = m_clients[username];
-            if (worker != exclude) {
-                worker->sendJson(message);
+    quint32 userId = worker->userId();
+    QString username = worker->getUsername();
+    MessageStore *store = m_messageStore;
+    m_readPool->start([this, store, worker, userId, username, afterId, flushStore](QSqlDatabase &connection) {
+        if (flushStore) {
+            store->flush();
+        }
+        Database db(connection);
+        bool hasMore = false;
+        QJsonArray messages = db.getOfflineMessagesPage(username, afterId, OfflinePageSize, &hasMore);
+        m_readPool->deliver([this, worker, userId, messages, hasMore]() {
+            if (hasSession(worker, userId)) {
+                sendMessagePage(worker, "offline_messages", messages, hasMore, false);
             }
+        });
+    });
+}
+
+void ChatServer::sendDeltaPage(ServerWorker *worker, qint64 afterId, bool flushStore)
+{
+    quint32 userId = worker->userId();
+    QString username = worker->getUsername();
+    const QSet<QString> groups = m_groupIndex.groupsOf(userId);
+    QStringList groupNames(groups.begin(), groups.end());
+    MessageStore *store = m_messageStore;
+    m_readPool->start([this, store, worker, userId, username, groupNames, afterId,
+                       flushStore](QSqlDatabase &connection) {
+        if (flushStore) {
+            store->flush();
+        }
+        Database db(connection);
+        bool hasMore = false;
+        QJsonArray messages = db.getMessagesSince(username, groupNames, afterId, OfflinePageSize, &hasMore);
+        m_readPool->deliver([this, worker, userId, messages, hasMore]() {
+            if (hasSession(worker, userId)) {
+                sendMessagePage(worker, "message_delta", messages, hasMore, true);
+            }
+        });
+    });
+}
+
+bool ChatServer::hasSession(ServerWorker *worker, quint32 userId) const
+{
+    const QVector<ServerWorker*> *workers = m_sessions.sessions(userId);
+    return workers && workers->contains(worker);
+}
+
+void ChatServer::loadBootstrap(ServerWorker *sender, quint32 userId, const QString &username, bool combined)
+{
+    QSharedPointer<BootstrapData> data(new BootstrapData);
+    data->remaining.storeRelaxed(4);
+
+    // 四项查询互不依赖，各自在只读连接上执行，最后一项完成时回到本线程发送
+    auto done = [this, data, sender, userId, username, combined]() {
+        if (!data->remaining.deref()) {
+            m_readPool->deliver([this, data, sender, userId, username, combined]() {
+                sendBootstrap(sender, userId, username, combined, *data);
+            });
+        }
+    };
+
+    m_readPool->start([data, username, done](QSqlDatabase &connection) {
+        Database db(connection);
+        data->userInfo = db.getUserInfo(username);
+        done();
+    });
+    m_readPool->start([data, username, done](QSqlDatabase &connection) {
+        Database db(connection);
+        data->contacts = db.getContacts(username);
+        done();
+    });
+    m_readPool->start([data, username, done](QSqlDatabase &connection) {
+        Database db(connection);
+        data->groups = db.getUserGroups(username);
+        done();
+    });
+    // 先让写线程提交队列中发给该用户的消息，离线消息才能读到；在池线程里等，不阻塞事件循环
+    MessageStore *store = m_messageStore;
+    m_readPool->start([store, data, username, done](QSqlDatabase &connection) {
+        store->flush();
+        Database db(connection);
+        data->offlineMessages = db.getOfflineMessagesPage(username, 0, OfflinePageSize, &data->offlineHasMore);
+        done();
+    });
+}
+
+void ChatServer::sendBootstrap(ServerWorker *sender, quint32 userId, const QString &username, bool combined,
+                               const BootstrapData &data)
+{
+    // 读取期间连接已断开
+    if (!hasSession(sender, userId))
+        return;
+
+    // 断线重连时用令牌恢复会话，不必再走密码校验和完整的初始化
+    QString token = m_sessionTokens.issue(userId, username);
+    QJsonObject offlineMsg = buildMessagePage(sender, "offline_messages", data.offlineMessages,
+                                              data.offlineHasMore, false);
+
+    if (combined) {
+        QJsonObject bootstrap;
+        bootstrap["type"] = "bootstrap";
+        bootstrap["username"] = username;
+        bootstrap["userInfo"] = data.userInfo;
+        bootstrap["token"] = token;
+        bootstrap["contacts"] = data.contacts;
+        bootstrap["groups"] = data.groups;
+        if (!offlineMsg.isEmpty()) {
+            bootstrap["offline"] = offlineMsg;
         }
+        sender->sendJson(bootstrap);
+        return;
+    }
+
+    QJsonObject response;
+    response["type"] = "login_success";
+    response["username"] = username;
+    response["userInfo"] = data.userInfo;
+    response["token"] = token;
+    sender->sendJson(response);
+
+    // 发送联系人列表
+    QJsonObject contactsMsg;
+    contactsMsg["type"] = "contacts_list";
+    contactsMsg["contacts"] = data.contacts;
+    sender->sendJson(contactsMsg);
+
+    // 发送群组列表
+    QJsonObject groupsMsg;
+    groupsMsg["type"] = "groups_list";
+    groupsMsg["groups"] = data.groups;
+    sender->sendJson(groupsMsg);
+
+    if (!offlineMsg.isEmpty()) {
+        sender->sendJson(offlineMsg);
+    }
+}
+
+void ChatServer::sendMessagePage(ServerWorker *worker, const QString &type, const QJsonArray &messages,
+                                 bool hasMore, bool delta)
+{
+    QJsonObject page = buildMessagePage(worker, type, messages, hasMore, delta);
+    if (!page.isEmpty()) {
+        worker->sendJson(page);
+    }
+}
+
+QJsonObject ChatServer::buildMessagePage(ServerWorker *worker, const QString &type, const QJsonArray &messages,
+                                         bool hasMore, bool delta)
+{
+    if (messages.isEmpty())
+        return QJsonObject();
+
+    OfflineCursor cursor;
+    cursor.hasMore = hasMore;
+    cursor.delta = delta;
+    for (const QJsonValue &value : messages) {
+        QJsonObject message = value.toObject();
+        qint64 messageId = message["id"].toVariant().toLongLong();
+        // 群消息没有逐人的已读标记
+        if (message["message_type"].toString() != "group") {
+            cursor.pendingIds.append(messageId);
+        }
+        cursor.lastId = qMax(cursor.lastId, messageId);
+    }
+    m_offlineCursors.insert(worker, cursor);
+
+    // 等客户端用offline_ack确认cursor后才标记已读，连接中断的消息下次登录会重发
+    QJsonObject page;
+    page["type"] = type;
+    page["messages"] = messages;
+    page["cursor"] = cursor.lastId;
+    page["has_more"] = hasMore;
+    return page;
+}
+
+void ChatServer::notifyPresence(quint32 userId, const QString &username, bool online)
+{
+    QSet<quint32> recipients = m_presenceWatchers.value(userId);
+    const QSet<QString> groups = m_groupIndex.groupsOf(userId);
+    for (const QString &groupName : groups) {
+        recipients.unite(m_groupIndex.onlineMembers(groupName));
+    }
+    recipients.remove(userId);
+
+    for (quint32 recipient : recipients) {
+        if (m_sessions.isOnline(recipient)) {
+            m_presenceBatcher->post(recipient, username, online);
+        }
+    }
+}
+
+void ChatServer::broadcastToAll(const QJsonObject &message, ServerWorker *exclude,
+                                ServerWorker::Priority priority)
+{
+    // 只编码一次，所有接收者共享同一帧
+    FramedMessage frame = FramedMessage::fromJson(message);
+    const QVector<ServerWorker*> workers = m_sessions.allSessions();
+    for (ServerWorker *worker : workers) {
+        if (worker != exclude) {
+            worker->sendFrame(frame, priority);
+        }
+    }
+}
+
+int ChatServer::sendToUser(quint32 userId, const FramedMessage &frame, ServerWorker *exclude)
+{
+    const QVector<ServerWorker*> *workers = m_sessions.sessions(userId);
+    if (!workers)
+        return 0;
+    int sent = 0;
+    for (ServerWorker *worker : *workers) {
+        if (worker != exclude) {
+            worker->sendFrame(frame);
+            ++sent;
+        }
+    }
+    return sent;
+}
+
+int ChatServer::sendToGroup(const QString &groupName, const FramedMessage &frame, ServerWorker *exclude)
+{
+    TraceSpan span("fanout:group");
+    // 只遍历在线成员，不再每条消息查询数据库
+    const QSet<quint32> members = m_groupIndex.onlineMembers(groupName);
+    int sent = 0;
+    for (quint32 userId : members) {
+        sent += sendToUser(userId, frame, exclude);
+    }
+    return sent;
+}
+
+quint32 ChatServer::resolveUserId(const QString &username)
+{
+    quint32 userId = m_sessions.userId(username);
+    if (userId == 0) {
+        userId = m_database->getUserId(username);
     }
+    return userId;
 }
@@ -3,10 +3,28 @@
 
 #include <QTcpServer>
 #include <QObject>
-#include <QMap>
+#include <QSet>
+#include <QHash>
+#include <QQueue>
+#include <QVector>
 #include <QString>
+#include <QAtomicInt>
+#include <QHostAddress>
+#include <QTimer>
+#include <QElapsedTimer>
 #include "serverworker.h"
 #include "database.h"
+#include "iothreadpool.h"
+#include "groupindex.h"
+#include "messagestore.h"
+#include "presencebatcher.h"
+#include "sessionregistry.h"
+#include "loginservice.h"
+#include "sessiontoken.h"
+#include "dbreadpool.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "tracer.h"
 
 class ChatServer : public QTcpServer
 {
@@ -18,6 +36,33 @@ public:
 
     void stopServer();
 
+    // I/O线程池配置，需在listen()之前调用
+    void setIoThreadCount(int count);
+    void setLoadBalancePolicy(IoThreadPool::Policy policy);
+    // 每个连接的出站积压上限，见ServerWorker::setOutboundLimits
+    void setOutboundLimits(qint64 dropMark, qint64 disconnectMark);
+    IoThreadPool *ioThreadPool() const { return m_ioThreads; }
+    // 消息持久化配置：刷新间隔、批大小、持久性
+    MessageStore *messageStore() const { return m_messageStore; }
+    // 登录校验线程池：并发上限、排队上限和排队深度
+    LoginService *loginService() const { return m_loginService; }
+    // 会话令牌的签名密钥（为空则随机生成）和有效期
+    void setSessionTokenSecret(const QByteArray &secret) { m_sessionTokens.setSecret(secret); }
+    void setSessionTokenLifetime(int seconds) { m_sessionTokens.setLifetime(seconds); }
+    // 登录初始数据等只读查询使用的线程池
+    DbReadPool *readPool() const { return m_readPool; }
+    // 在管理端口上以Prometheus文本格式导出MetricsRegistry::global()中的指标
+    bool startMetricsServer(quint16 port, const QHostAddress &address = QHostAddress::LocalHost);
+
+    // 每种消息类型的处理次数和累计耗时
+    struct DispatchStats {
+        QString type;
+        quint64 calls;
+        qint64 totalNs;
+    };
+    QVector<DispatchStats> dispatchStats() const;
+    quint64 unknownMessageCount() const { return m_unknownMessages; }
+
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 
@@ -27,16 +72,179 @@ signals:
     void userDisconnected(const QString &username);
 
 public slots:
-    void jsonReceived(ServerWorker *sender, const QJsonObject &docObj);
+    void jsonReceived(ServerWorker *sender, const QJsonObject &docObj, quint64 traceId = 0);
+    void relayReceived(ServerWorker *sender, const RelayMessage &message);
     void onUserDisconnected(ServerWorker *sender);
 
 private:
-    void broadcastToAll(const QJsonObject &message, ServerWorker *exclude = nullptr);
-    void sendToUser(const QString &username, const QJsonObject &message);
-    void sendToGroup(const QString &groupName, const QJsonObject &message, ServerWorker *exclude = nullptr);
+    typedef void (ChatServer::*Handler)(ServerWorker *sender, const QJsonObject &docObj);
+
+    // 分发表中的一项，下标即消息类型的内部id
+    struct DispatchEntry {
+        QString type;
+        Handler handler = nullptr;
+        quint64 calls = 0;
+        qint64 totalNs = 0;
+        MetricCounter *received = nullptr;
+        MetricHistogram *handleTime = nullptr;
+        const char *traceName = nullptr;  // 跟踪区间名 "dispatch:<type>"
+    };
+
+    // 计入分发统计和对应类型的指标
+    void recordDispatch(int typeId, qint64 elapsedNs);
+    // 定时采样：事件循环延迟，以及会话数、队列深度等仪表
+    void sampleMetrics();
+
+    void registerHandlers();
+    void registerHandler(const QString &type, Handler handler);
+
+    // 各类型消息的处理函数
+    void handleHello(ServerWorker *sender, const QJsonObject &docObj);
+    void handleLogin(ServerWorker *sender, const QJsonObject &docObj);
+    void handleResume(ServerWorker *sender, const QJsonObject &docObj);
+    void handleOfflineAck(ServerWorker *sender, const QJsonObject &docObj);
+    void handleRegister(ServerWorker *sender, const QJsonObject &docObj);
+    void handlePrivateMessage(ServerWorker *sender, const QJsonObject &docObj);
+    void handleGroupMessage(ServerWorker *sender, const QJsonObject &docObj);
+    // 转发快速通道：元数据单独序列化，content原样拼接
+    void relayPrivateMessage(ServerWorker *sender, const RelayMessage &relay);
+    void relayGroupMessage(ServerWorker *sender, const RelayMessage &relay);
+    void routePrivateMessage(ServerWorker *sender, const QString &receiver, const FramedMessage &frame);
+    // 客户端带了client_id时只回一个简短的ack（同一轮事件循环内合并），否则回显完整私聊消息
+    void confirmToSender(ServerWorker *sender, qint64 clientId, const QJsonObject &message,
+                         const FramedMessage &frame);
+    void queueAck(ServerWorker *sender, const QJsonObject &ack);
+    void flushAcks();
+    // 按(user, client_id)去重：记住最近确认过的消息，重复的只重发原来的ack，返回true表示已处理
+    void rememberSend(quint32 userId, qint64 clientId, const QJsonObject &ack);
+    bool acknowledgeDuplicate(ServerWorker *sender, qint64 clientId);
+    // 清理已下线且令牌已过期的用户的去重窗口，最多每分钟一次
+    void sweepRecentSends();
+    // 消息没能进入写队列：不转发，告诉发送者这条消息失败
+    void rejectMessage(ServerWorker *sender, qint64 clientId);
+    void handleAddContact(ServerWorker *sender, const QJsonObject &docObj);
+    void handleCreateGroup(ServerWorker *sender, const QJsonObject &docObj);
+    void handleJoinGroup(ServerWorker *sender, const QJsonObject &docObj);
+    void handleAddGroupMembers(ServerWorker *sender, const QJsonObject &docObj);
+    void handleGetHistory(ServerWorker *sender, const QJsonObject &docObj);
+
+    // 凭据校验完成后在本线程继续处理
+    void completeLogin(ServerWorker *sender, quint64 ticket, const QString &username, bool combined,
+                       bool ok, quint32 userId);
+    void completeRegister(ServerWorker *sender, quint64 ticket, const QString &username, bool ok);
+
+    // 每页离线消息条数
+    static constexpr int OfflinePageSize = 200;
+    // get_history每页条数的默认值和上限
+    static constexpr int DefaultHistoryPageSize = 100;
+    static constexpr int MaxHistoryPageSize = 500;
 
-    QMap<QString, ServerWorker*> m_clients;  // username -> worker
+    // 登录后的初始数据：用户信息、联系人、群组和第一页离线消息
+    struct BootstrapData {
+        QJsonObject userInfo;
+        QJsonArray contacts;
+        QJsonArray groups;
+        QJsonArray offlineMessages;
+        bool offlineHasMore = false;
+        QAtomicInt remaining;
+    };
+
+    // 每个用户最近确认过的client_id
+    struct RecentSends {
+        QHash<qint64, QJsonObject> acks;  // client_id -> 当时的ack
+        QQueue<qint64> order;             // 超过窗口时先淘汰最旧的
+        qint64 expiresMs = 0;             // 全部设备下线后保留到会话令牌过期，0表示在线
+    };
+    static constexpr int RecentSendWindow = 256;
+    static constexpr qint64 RecentSendsSweepIntervalMs = 60000;
+
+    // 已发出、等待客户端确认的一页离线消息
+    struct OfflineCursor {
+        qint64 lastId = 0;
+        QList<qint64> pendingIds;
+        bool hasMore = false;
+        bool delta = false;  // 断线重连的增量消息，而不是未读离线消息
+    };
+
+    // 登录或恢复成功后登记会话，该用户的第一个会话还会更新在线状态并通知关心他的用户
+    quint32 openSession(ServerWorker *sender, quint32 userId, const QString &username);
+    // users表的在线状态交给消息写线程更新
+    void postUserStatus(const QString &username, bool online);
+    // 联系人、群组等写操作也在消息写线程上执行（整个服务器只有一个写连接），
+    // done带着结果回到本线程；写线程没有运行时直接以失败回调
+    void postWrite(const std::function<bool(Database &db)> &write, const std::function<void(bool ok)> &done);
+    // 在只读线程池上查询群组列表；worker为空时发给该用户的所有设备
+    void sendGroupsList(quint32 userId, const QString &username, ServerWorker *worker = nullptr);
+    // 离线消息和增量消息在只读线程池上查询，结果回到本线程发送；
+    // flushStore为true时先把排队的消息写入数据库，保证查询能看到它们
+    void sendOfflinePage(ServerWorker *worker, qint64 afterId, bool flushStore = false);
+    void sendDeltaPage(ServerWorker *worker, qint64 afterId, bool flushStore = false);
+    // 异步查询返回时连接可能已断开或换了用户
+    bool hasSession(ServerWorker *worker, quint32 userId) const;
+    void sendMessagePage(ServerWorker *worker, const QString &type, const QJsonArray &messages,
+                         bool hasMore, bool delta);
+    // 生成一页消息并记录等待确认的cursor，没有消息时返回空对象
+    QJsonObject buildMessagePage(ServerWorker *worker, const QString &type, const QJsonArray &messages,
+                                 bool hasMore, bool delta);
+    // 在只读线程池上并行读取初始数据；combined为true时合并成一个bootstrap帧发送
+    void loadBootstrap(ServerWorker *sender, quint32 userId, const QString &username, bool combined);
+    void sendBootstrap(ServerWorker *sender, quint32 userId, const QString &username, bool combined,
+                       const BootstrapData &data);
+    // 只通知把该用户加为联系人或与其同群的在线用户，变化经PresenceBatcher合并后发送
+    void notifyPresence(quint32 userId, const QString &username, bool online);
+    void broadcastToAll(const QJsonObject &message, ServerWorker *exclude = nullptr,
+                        ServerWorker::Priority priority = ServerWorker::NormalPriority);
+    // 发给该用户所有在线设备，exclude用于跳过发起请求的那个连接
+    // 返回实际发出的连接数
+    int sendToUser(quint32 userId, const FramedMessage &frame, ServerWorker *exclude = nullptr);
+    int sendToGroup(const QString &groupName, const FramedMessage &frame, ServerWorker *exclude = nullptr);
+    // 先查登录时驻留的id，未登录过的用户再查数据库
+    quint32 resolveUserId(const QString &username);
+
+    SessionRegistry m_sessions;              // user id -> 在线连接（可多设备）
+    GroupIndex m_groupIndex;                 // 群成员及在线成员索引
+    QHash<ServerWorker*, OfflineCursor> m_offlineCursors;
+    SessionTokenSigner m_sessionTokens;
+    QHash<ServerWorker*, quint64> m_pendingAuth;  // 凭据校验尚未返回的连接 -> 请求编号
+    QHash<quint32, QSet<quint32>> m_presenceWatchers;  // 在线用户 -> 把他加为联系人的用户
+    PresenceBatcher *m_presenceBatcher;
+
+    QHash<QString, int> m_typeIds;     // 消息类型 -> 分发表下标
+    QVector<DispatchEntry> m_handlers;
+    quint64 m_unknownMessages;
     Database *m_database;
+    IoThreadPool *m_ioThreads;
+    qint64 m_outboundDropMark;
+    qint64 m_outboundDisconnectMark;
+    MessageStore *m_messageStore;
+    LoginService *m_loginService;
+    DbReadPool *m_readPool;
+    QHash<ServerWorker*, QJsonArray> m_pendingAcks;
+    bool m_ackFlushScheduled;
+    quint64 m_authTickets;
+    QHash<quint32, RecentSends> m_recentSends;
+    qint64 m_recentSendsSweepMs;
+
+    // 指标采样间隔；实际间隔超出的部分即事件循环延迟
+    static constexpr int MetricsSampleIntervalMs = 100;
+
+    struct ServerMetrics {
+        MetricCounter *unknownMessages;
+        MetricCounter *connectionsAccepted;
+        MetricGauge *connections;
+        MetricGauge *sessions;
+        MetricGauge *onlineUsers;
+        MetricGauge *loginQueueDepth;
+        MetricGauge *loginActive;
+        MetricGauge *storePending;
+        MetricHistogram *privateFanout;
+        MetricHistogram *groupFanout;
+        MetricHistogram *eventLoopLag;
+    };
+    ServerMetrics m_metrics;
+    QTimer m_metricsTimer;
+    QElapsedTimer m_metricsClock;
+    MetricsServer *m_metricsServer;
 };
 
 #endif // CHATSERVER_H
@@ -22,6 +22,15 @@ ChatWindow::ChatWindow(const QString &target, const QString &type,
     ui->setupUi(this);
     setupUI();
     loadHistory();
+
+    // 收到ack即已送达；失败的消息在窗口里提示
+    connect(m_chatClient, &ChatClient::messageAcknowledged, this,
+            [this](qint64 clientId, qint64 serverId, const QString &timestamp) {
+        Q_UNUSED(serverId);
+        Q_UNUSED(timestamp);
+        m_pendingSends.remove(clientId);
+    });
+    connect(m_chatClient, &ChatClient::messageFailed, this, &ChatWindow::onMessageFailed);
 }
 
 ChatWindow::~ChatWindow()
@@ -280,6 +289,10 @@ void ChatWindow::on_sendButton_clicked()
         message["group_name"] = m_target;
     }
     message["content"] = content;
+    // 服务器只回一个带client_id的ack，不再回显整条消息；断线时消息排队，恢复会话后重发
+    qint64 clientId = m_chatClient->nextClientId();
+    message["client_id"] = clientId;
+    m_pendingSends.insert(clientId, content);
 
     m_chatClient->sendJson(message);
 
@@ -301,6 +314,23 @@ void ChatWindow::on_backButton_clicked()
     emit backButtonClicked();
 }
 
+void ChatWindow::onMessageFailed(qint64 clientId, const QString &reason)
+{
+    auto it = m_pendingSends.find(clientId);
+    if (it == m_pendingSends.end())
+        return;
+
+    QString notice = QString("<div style='text-align: center; margin: 6px 0; font-size: 12px; color: #fa5151;'>"
+                             "消息发送失败：%1（%2）"
+                             "</div>")
+                     .arg(it.value().toHtmlEscaped(), reason.toHtmlEscaped());
+    m_pendingSends.erase(it);
+    ui->messageTextEdit->append(notice);
+
+    QScrollBar *scrollBar = ui->messageTextEdit->verticalScrollBar();
+    scrollBar->setValue(scrollBar->maximum());
+}
+
 void ChatWindow::closeEvent(QCloseEvent *event)
 {
     emit windowClosed(m_target);
@@ -3,6 +3,7 @@
 
 #include <QWidget>
 #include <QString>
+#include <QHash>
 #include "chatclient.h"
 #include "database.h"
 
@@ -34,6 +35,7 @@ private slots:
     void on_sendButton_clicked();
     void on_messageLineEdit_returnPressed();
     void on_backButton_clicked();
+    void onMessageFailed(qint64 clientId, const QString &reason);
 
 private:
     Ui::ChatWindow *ui;
@@ -44,6 +46,7 @@ private:
     Database *m_database;
     QDateTime m_lastMessageTime;  // 上一条消息的时间，用于时间分组
     bool m_isFirstMessage;  // 是否是第一条消息
+    QHash<qint64, QString> m_pendingSends;  // 本窗口发出、等待服务器确认的消息 client_id -> 内容
 
     void setupUI();
     void displayMessage(const QString &sender, const QString &content, const QString &timestamp, bool isSelf);
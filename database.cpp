@@ -1,8 +1,62 @@
 #include "database.h"
+#include "sqlitetuning.h"
+#include "sqlstatementcache.h"
+#include <QAtomicInt>
 #include <QDebug>
+#include <QSet>
+
+// 迁移时每批回填的行数，每批是一个独立的短事务，不会长时间锁住写入
+static const int MigrationBatchSize = 5000;
+
+// 进程内是否还有没回填会话标识的旧消息，只读连接上的查询据此决定是否兼容NULL
+static QAtomicInt s_backfillPending(0);
+
+// 回填完成前旧行的conversation_id和created_ms还是NULL：按原来的列再匹配一次，
+// 时间用created_at换算。回填结束后查询只走(conversation_id, id)索引
+static QString conversationFilter(bool pending, const QString &messageType)
+{
+    if (!pending)
+        return "conversation_id = ?";
+    if (messageType == "private")
+        return "(conversation_id = ? OR (conversation_id IS NULL AND message_type = 'private' "
+               "AND ((sender = ? AND receiver = ?) OR (sender = ? AND receiver = ?))))";
+    return "(conversation_id = ? OR (conversation_id IS NULL AND message_type = 'group' AND group_name = ?))";
+}
+
+static void bindConversation(QSqlQuery &query, bool pending, const QString &messageType,
+                             const QString &currentUser, const QString &target)
+{
+    query.addBindValue(messageType == "private"
+                       ? Database::conversationId(messageType, currentUser, target, QString())
+                       : Database::conversationId(messageType, QString(), QString(), target));
+    if (!pending)
+        return;
+    if (messageType == "private") {
+        query.addBindValue(currentUser);
+        query.addBindValue(target);
+        query.addBindValue(target);
+        query.addBindValue(currentUser);
+    } else {
+        query.addBindValue(target);
+    }
+}
+
+static QString createdMsColumn(bool pending)
+{
+    return pending ? "COALESCE(created_ms, CAST(ROUND((julianday(created_at) - 2440587.5) * 86400000.0) AS INTEGER))"
+                   : "created_ms";
+}
 
 Database::Database(QObject *parent)
     : QObject(parent)
+    , m_ownsConnection(true)
+{
+}
+
+Database::Database(const QSqlDatabase &connection, QObject *parent)
+    : QObject(parent)
+    , m_db(connection)
+    , m_ownsConnection(false)
 {
 }
 
@@ -11,16 +65,21 @@ Database::~Database()
     closeDatabase();
 }
 
-bool Database::initializeDatabase(const QString &dbPath)
+bool Database::initializeDatabase(const QString &dbPath, bool backfillInBackground)
 {
     m_db = QSqlDatabase::addDatabase("QSQLITE", "ClientConnection");
     m_db.setDatabaseName(dbPath);
 
     if (!m_db.open()) {
-        qDebug() << "无法打开数据库:" << m_db.lastError().text();
+        qCritical() << "无法打开数据库:" << m_db.lastError().text();
         return false;
     }
 
+    SqliteTuning::applyConnectionPragmas(m_db);
+    if (SqliteTuning::options().wal) {
+        SqliteTuning::enableWal(m_db);
+    }
+
     QSqlQuery query(m_db);
 
     // 创建消息表
@@ -32,21 +91,128 @@ bool Database::initializeDatabase(const QString &dbPath)
                "message_type TEXT NOT NULL DEFAULT 'private',"
                "group_name TEXT,"
                "timestamp TEXT,"
-               "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
+               "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+               "conversation_id TEXT,"
+               "created_ms INTEGER"
                ")");
 
     // 创建索引
     query.exec("CREATE INDEX IF NOT EXISTS idx_messages_target ON messages(receiver, message_type)");
     query.exec("CREATE INDEX IF NOT EXISTS idx_messages_group ON messages(group_name)");
 
+    return migrateMessagesSchema(!backfillInBackground);
+}
+
+bool Database::migrateMessagesSchema(bool backfill)
+{
+    QSqlQuery query(m_db);
+
+    if (query.exec("PRAGMA user_version") && query.next()
+            && query.value(0).toInt() >= MessagesSchemaVersion) {
+        s_backfillPending.storeRelaxed(0);
+        return true;
+    }
+
+    QSet<QString> columns;
+    if (query.exec("PRAGMA table_info(messages)")) {
+        while (query.next()) {
+            columns.insert(query.value(1).toString());
+        }
+    }
+
+    // ADD COLUMN只修改表定义，不会重写已有数据
+    if (!columns.contains("conversation_id")
+            && !query.exec("ALTER TABLE messages ADD COLUMN conversation_id TEXT")) {
+        qWarning() << "添加conversation_id列失败:" << query.lastError().text();
+        return false;
+    }
+    if (!columns.contains("created_ms")
+            && !query.exec("ALTER TABLE messages ADD COLUMN created_ms INTEGER")) {
+        qWarning() << "添加created_ms列失败:" << query.lastError().text();
+        return false;
+    }
+
+    // 会话内按id翻页可以直接走这个索引，不需要额外排序
+    query.exec("CREATE INDEX IF NOT EXISTS idx_messages_conversation ON messages(conversation_id, id)");
+
+    // 回填完成前查询会同时匹配conversation_id为NULL的旧行
+    s_backfillPending.storeRelaxed(1);
+    if (!backfill)
+        return true;
+
+    // 分批回填，批与批之间其他连接可以正常读写
+    bool finished = false;
+    while (!finished) {
+        if (!backfillConversationIds(m_db, &finished))
+            return false;
+    }
     return true;
 }
 
+bool Database::backfillConversationIds(QSqlDatabase &db, bool *finished)
+{
+    QSqlQuery query(db);
+    bool hasTimestamp = false;
+    if (query.exec("PRAGMA table_info(messages)")) {
+        while (query.next()) {
+            hasTimestamp = hasTimestamp || query.value(1).toString() == "timestamp";
+        }
+    }
+
+    // 客户端库有单独的timestamp列，存的是不带时区的本地时间，要按本地时间换算；
+    // 服务端库只有created_at（CURRENT_TIMESTAMP，UTC）
+    QString julianExpr = hasTimestamp
+            ? "COALESCE(julianday(NULLIF(timestamp, ''), 'utc'), julianday(created_at))"
+            : "julianday(created_at)";
+
+    QString backfill = QString(
+        "UPDATE messages SET "
+        "conversation_id = CASE WHEN message_type = 'group' THEN 'g:' || COALESCE(group_name, '') "
+        "ELSE 'p:' || MIN(sender, receiver) || ':' || MAX(sender, receiver) END, "
+        "created_ms = CAST(ROUND((%1 - 2440587.5) * 86400000.0) AS INTEGER) "
+        "WHERE id IN (SELECT id FROM messages WHERE conversation_id IS NULL LIMIT %2)")
+        .arg(julianExpr).arg(MigrationBatchSize);
+
+    if (!query.exec(backfill)) {
+        qWarning() << "回填会话标识失败:" << query.lastError().text();
+        return false;
+    }
+
+    *finished = query.numRowsAffected() < MigrationBatchSize;
+    if (*finished) {
+        query.exec(QString("PRAGMA user_version = %1").arg(MessagesSchemaVersion));
+        s_backfillPending.storeRelaxed(0);
+    }
+    return true;
+}
+
+bool Database::backfillPending()
+{
+    return s_backfillPending.loadRelaxed() != 0;
+}
+
+QString Database::conversationId(const QString &messageType, const QString &sender,
+                                 const QString &receiver, const QString &groupName)
+{
+    if (messageType == "group")
+        return "g:" + groupName;
+
+    // SQLite的MIN/MAX按UTF-8字节比较，这里保持一致
+    bool senderFirst = sender.toUtf8() < receiver.toUtf8();
+    const QString &first = senderFirst ? sender : receiver;
+    const QString &second = senderFirst ? receiver : sender;
+    return "p:" + first + ":" + second;
+}
+
 bool Database::closeDatabase()
 {
+    if (!m_ownsConnection)
+        return true;
+
     if (m_db.isOpen()) {
         m_db.close();
     }
+    SqlStatementCache::release("ClientConnection");
     QSqlDatabase::removeDatabase("ClientConnection");
     return true;
 }
@@ -54,46 +220,46 @@ bool Database::closeDatabase()
 bool Database::saveMessage(const QString &sender, const QString &receiver, const QString &content,
                           const QString &messageType, const QString &groupName, const QString &timestamp)
 {
-    QSqlQuery query(m_db);
-    query.prepare("INSERT INTO messages (sender, receiver, content, message_type, group_name, timestamp) "
-                  "VALUES (?, ?, ?, ?, ?, ?)");
+    QDateTime time = timestamp.isEmpty() ? QDateTime::currentDateTime()
+                                         : QDateTime::fromString(timestamp, Qt::ISODate);
+    if (!time.isValid()) {
+        time = QDateTime::currentDateTime();
+    }
+
+    SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(m_db)->prepare(
+                "save_message",
+                "INSERT INTO messages (sender, receiver, content, message_type, group_name, timestamp, "
+                "conversation_id, created_ms) VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+    QSqlQuery &query = statement.query;
     query.addBindValue(sender);
     query.addBindValue(receiver);
     query.addBindValue(content);
     query.addBindValue(messageType);
     query.addBindValue(groupName);
-    query.addBindValue(timestamp.isEmpty() ? QDateTime::currentDateTime().toString(Qt::ISODate) : timestamp);
+    query.addBindValue(timestamp.isEmpty() ? time.toString(Qt::ISODate) : timestamp);
+    query.addBindValue(conversationId(messageType, sender, receiver, groupName));
+    query.addBindValue(time.toMSecsSinceEpoch());
 
-    return query.exec();
+    return statement.exec();
 }
 
 QJsonArray Database::getMessages(const QString &target, const QString &messageType, 
                                 const QString &currentUser, int limit)
 {
     QJsonArray messages;
-    QSqlQuery query(m_db);
 
-    if (messageType == "private") {
-        // 查询所有与target相关的私聊消息（无论是sender还是receiver）
-        // currentUser是当前登录用户，target是聊天对象
-        query.prepare("SELECT sender, receiver, content, timestamp FROM messages "
-                      "WHERE ((sender = ? AND receiver = ?) OR (sender = ? AND receiver = ?)) "
-                      "AND message_type = 'private' "
-                      "ORDER BY created_at DESC LIMIT ?");
-        query.addBindValue(currentUser);  // sender = currentUser, receiver = target
-        query.addBindValue(target);
-        query.addBindValue(target);        // sender = target, receiver = currentUser
-        query.addBindValue(currentUser);
-        query.addBindValue(limit);
-    } else {
-        query.prepare("SELECT sender, receiver, content, timestamp FROM messages "
-                      "WHERE group_name = ? AND message_type = 'group' "
-                      "ORDER BY created_at DESC LIMIT ?");
-        query.addBindValue(target);
-        query.addBindValue(limit);
-    }
+    // 私聊和群聊都按会话标识查询，走(conversation_id, id)索引
+    bool pending = backfillPending();
+    SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(m_db)->prepare(
+                "get_messages",
+                "SELECT sender, receiver, content, timestamp FROM messages "
+                "WHERE " + conversationFilter(pending, messageType) + " "
+                "ORDER BY id DESC LIMIT ?");
+    QSqlQuery &query = statement.query;
+    bindConversation(query, pending, messageType, currentUser, target);
+    query.addBindValue(limit);
 
-    if (query.exec()) {
+    if (statement.exec()) {
         while (query.next()) {
             QJsonObject message;
             message["sender"] = query.value(0).toString();
@@ -103,6 +269,8 @@ QJsonArray Database::getMessages(const QString &target, const QString &messageTy
             messages.append(message);
         }
     }
+    // 语句由缓存复用，不会随函数返回析构；读完及时释放，未读完的结果集会一直占着读事务，挡住WAL检查点
+    query.finish();
 
     return messages;
 }
@@ -112,3 +280,296 @@ bool Database::clearMessages()
     QSqlQuery query(m_db);
     return query.exec("DELETE FROM messages");
 }
+
+quint32 Database::getUserId(const QString &username)
+{
+    SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(m_db)->prepare(
+                "get_user_id",
+                "SELECT id FROM users WHERE username = ?");
+    QSqlQuery &query = statement.query;
+    query.addBindValue(username);
+
+    quint32 userId = 0;
+    if (statement.exec() && query.next()) {
+        userId = query.value(0).toUInt();
+    }
+    query.finish();
+    return userId;
+}
+
+QList<quint32> Database::getContactOwners(quint32 userId)
+{
+    QList<quint32> owners;
+    SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(m_db)->prepare(
+                "get_contact_owners",
+                "SELECT user_id FROM contacts WHERE contact_id = ?");
+    QSqlQuery &query = statement.query;
+    query.addBindValue(userId);
+
+    if (statement.exec()) {
+        while (query.next()) {
+            owners << query.value(0).toUInt();
+        }
+    } else {
+        qWarning() << "查询联系人关系失败:" << query.lastError().text();
+    }
+    query.finish();
+
+    return owners;
+}
+
+QHash<QString, QList<quint32>> Database::getAllGroupMemberships()
+{
+    QHash<QString, QList<quint32>> memberships;
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+
+    if (query.exec("SELECT g.group_name, gm.user_id FROM group_members gm "
+                   "JOIN groups g ON g.id = gm.group_id")) {
+        while (query.next()) {
+            memberships[query.value(0).toString()].append(query.value(1).toUInt());
+        }
+    } else {
+        qWarning() << "加载群成员失败:" << query.lastError().text();
+    }
+
+    return memberships;
+}
+
+QJsonArray Database::getMessagesPage(const QString &currentUser, const QString &target, const QString &messageType,
+                                     qint64 beforeId, qint64 afterId, int limit, bool *hasMore)
+{
+    QJsonArray messages;
+
+    // 游标条件和排序方向：向后翻页时按id升序取，返回前再倒过来
+    bool forward = afterId > 0 && beforeId <= 0;
+    QString cursorClause;
+    if (forward) {
+        cursorClause = "AND id > ? ORDER BY id ASC LIMIT ?";
+    } else if (beforeId > 0) {
+        cursorClause = "AND id < ? ORDER BY id DESC LIMIT ?";
+    } else {
+        cursorClause = "ORDER BY id DESC LIMIT ?";
+    }
+
+    bool pending = backfillPending();
+    SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(m_db)->prepare(
+                "get_messages_page",
+                "SELECT id, sender, receiver, content, " + createdMsColumn(pending) + " FROM messages "
+                "WHERE " + conversationFilter(pending, messageType) + " " + cursorClause);
+    QSqlQuery &query = statement.query;
+    bindConversation(query, pending, messageType, currentUser, target);
+    if (forward) {
+        query.addBindValue(afterId);
+    } else if (beforeId > 0) {
+        query.addBindValue(beforeId);
+    }
+    // 多取一条用来判断是否还有下一页
+    query.addBindValue(limit + 1);
+
+    bool more = false;
+    if (statement.exec()) {
+        while (query.next()) {
+            if (messages.size() == limit) {
+                more = true;
+                break;
+            }
+            QJsonObject message;
+            message["id"] = query.value(0).toLongLong();
+            message["sender"] = query.value(1).toString();
+            message["receiver"] = query.value(2).toString();
+            message["content"] = query.value(3).toString();
+            message["timestamp"] = QDateTime::fromMSecsSinceEpoch(query.value(4).toLongLong())
+                                       .toString(Qt::ISODateWithMs);
+            messages.append(message);
+        }
+    } else {
+        qWarning() << "查询聊天记录失败:" << query.lastError().text();
+    }
+
+    if (forward) {
+        QJsonArray reversed;
+        for (int i = messages.size() - 1; i >= 0; --i) {
+            reversed.append(messages.at(i));
+        }
+        messages = reversed;
+    }
+    query.finish();
+
+    if (hasMore) {
+        *hasMore = more;
+    }
+    return messages;
+}
+
+QJsonArray Database::getOfflineMessagesPage(const QString &username, qint64 afterId, int limit, bool *hasMore)
+{
+    QJsonArray messages;
+
+    // 时间和历史记录、增量消息一样由created_ms生成；多取一条用来判断是否还有下一页
+    SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(m_db)->prepare(
+                "get_offline_messages_page",
+                "SELECT id, sender, receiver, content, message_type, group_name, "
+                + createdMsColumn(backfillPending()) + " FROM messages "
+                "WHERE receiver = ? AND is_read = 0 AND id > ? "
+                "ORDER BY id LIMIT ?");
+    QSqlQuery &query = statement.query;
+    query.addBindValue(username);
+    query.addBindValue(afterId);
+    query.addBindValue(limit + 1);
+
+    bool more = false;
+    if (statement.exec()) {
+        while (query.next()) {
+            if (messages.size() == limit) {
+                more = true;
+                break;
+            }
+            QJsonObject message;
+            message["id"] = query.value(0).toLongLong();
+            message["sender"] = query.value(1).toString();
+            message["receiver"] = query.value(2).toString();
+            message["content"] = query.value(3).toString();
+            message["message_type"] = query.value(4).toString();
+            message["group_name"] = query.value(5).toString();
+            message["timestamp"] = QDateTime::fromMSecsSinceEpoch(query.value(6).toLongLong())
+                                       .toString(Qt::ISODateWithMs);
+            messages.append(message);
+        }
+    } else {
+        qWarning() << "查询离线消息失败:" << query.lastError().text();
+    }
+    query.finish();
+
+    if (hasMore) {
+        *hasMore = more;
+    }
+    return messages;
+}
+
+QJsonArray Database::getMessagesSince(const QString &username, const QStringList &groupNames, qint64 afterId,
+                                      int limit, bool *hasMore)
+{
+    QJsonArray messages;
+
+    // 群聊按会话标识匹配，走(conversation_id, id)索引
+    bool pending = backfillPending();
+    QString groupClause;
+    if (!groupNames.isEmpty()) {
+        QStringList placeholders;
+        placeholders.reserve(groupNames.size());
+        for (int i = 0; i < groupNames.size(); ++i) {
+            placeholders << "?";
+        }
+        QString list = placeholders.join(",");
+        QString match = pending
+                ? QString("(conversation_id IN (%1) OR (conversation_id IS NULL AND message_type = 'group' "
+                          "AND group_name IN (%1)))").arg(list)
+                : QString("conversation_id IN (%1)").arg(list);
+        groupClause = QString(" OR (%1 AND sender != ?)").arg(match);
+    }
+
+    // 多取一条用来判断是否还有下一页
+    SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(m_db)->prepare(
+                "get_messages_since",
+                "SELECT id, sender, receiver, content, message_type, group_name, " + createdMsColumn(pending)
+                + " FROM messages "
+                "WHERE id > ? AND ((message_type = 'private' AND receiver = ?)" + groupClause + ") "
+                "ORDER BY id LIMIT ?");
+    QSqlQuery &query = statement.query;
+    query.addBindValue(afterId);
+    query.addBindValue(username);
+    if (!groupNames.isEmpty()) {
+        for (const QString &groupName : groupNames) {
+            query.addBindValue(conversationId("group", QString(), QString(), groupName));
+        }
+        if (pending) {
+            for (const QString &groupName : groupNames) {
+                query.addBindValue(groupName);
+            }
+        }
+        query.addBindValue(username);
+    }
+    query.addBindValue(limit + 1);
+
+    bool more = false;
+    if (statement.exec()) {
+        while (query.next()) {
+            if (messages.size() == limit) {
+                more = true;
+                break;
+            }
+            QJsonObject message;
+            message["id"] = query.value(0).toLongLong();
+            message["sender"] = query.value(1).toString();
+            message["receiver"] = query.value(2).toString();
+            message["content"] = query.value(3).toString();
+            message["message_type"] = query.value(4).toString();
+            message["group_name"] = query.value(5).toString();
+            message["timestamp"] = QDateTime::fromMSecsSinceEpoch(query.value(6).toLongLong())
+                                       .toString(Qt::ISODateWithMs);
+            messages.append(message);
+        }
+    } else {
+        qWarning() << "查询增量消息失败:" << query.lastError().text();
+    }
+    query.finish();
+
+    if (hasMore) {
+        *hasMore = more;
+    }
+    return messages;
+}
+
+bool Database::markMessagesAsRead(const QList<qint64> &messageIds)
+{
+    return markMessagesAsRead(m_db, messageIds);
+}
+
+bool Database::markMessagesAsRead(QSqlDatabase &db, const QList<qint64> &messageIds)
+{
+    if (messageIds.isEmpty())
+        return true;
+
+    // IN列表只用几种固定长度，语句缓存里最多多出四条；不足的位置重复最后一个id
+    static const int Arities[] = { 1, 8, 32, 128 };
+    static const int MaxArity = 128;
+
+    bool chunked = messageIds.size() > MaxArity;
+    if (chunked && !db.transaction())
+        return false;
+
+    for (int offset = 0; offset < messageIds.size(); offset += MaxArity) {
+        int count = qMin(MaxArity, messageIds.size() - offset);
+        int arity = MaxArity;
+        for (int candidate : Arities) {
+            if (candidate >= count) {
+                arity = candidate;
+                break;
+            }
+        }
+
+        QStringList placeholders;
+        placeholders.reserve(arity);
+        for (int i = 0; i < arity; ++i) {
+            placeholders << "?";
+        }
+
+        SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(db)->prepare(
+                    "mark_messages_read",
+                    QString("UPDATE messages SET is_read = 1 WHERE id IN (%1)").arg(placeholders.join(",")));
+        QSqlQuery &query = statement.query;
+        for (int i = 0; i < arity; ++i) {
+            query.addBindValue(messageIds.at(offset + qMin(i, count - 1)));
+        }
+
+        if (!statement.exec()) {
+            qWarning() << "标记消息已读失败:" << query.lastError().text();
+            if (chunked)
+                db.rollback();
+            return false;
+        }
+    }
+
+    return !chunked || db.commit();
+}
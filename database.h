@@ -9,6 +9,8 @@
 #include <QDateTime>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QHash>
+#include <QStringList>
 
 class Database : public QObject
 {
@@ -16,10 +18,26 @@ class Database : public QObject
 
 public:
     explicit Database(QObject *parent = nullptr);
+    // 借用已打开的连接（如只读线程池中的连接），析构时不关闭
+    explicit Database(const QSqlDatabase &connection, QObject *parent = nullptr);
     ~Database();
 
-    bool initializeDatabase(const QString &dbPath);
+    // backfillInBackground为true时只做结构升级，旧消息的回填交给MessageStore的写线程
+    bool initializeDatabase(const QString &dbPath, bool backfillInBackground = false);
     bool closeDatabase();
+    QString databasePath() const { return m_db.databaseName(); }
+
+    // 消息表结构升级：增加conversation_id和created_ms列，可重复执行；
+    // backfill为true时接着分批回填旧消息，否则由调用方在后台调用backfillConversationIds()
+    bool migrateMessagesSchema(bool backfill = true);
+    // 回填一批旧消息，全部完成时finished为true并写入新的结构版本
+    static bool backfillConversationIds(QSqlDatabase &db, bool *finished);
+    // 还有旧消息没回填时为true，期间的查询同时匹配conversation_id为NULL的行
+    static bool backfillPending();
+
+    // 会话标识：私聊为"p:<较小用户名>:<较大用户名>"，群聊为"g:<群名>"，与迁移时的SQL一致
+    static QString conversationId(const QString &messageType, const QString &sender,
+                                  const QString &receiver, const QString &groupName);
 
     // 消息管理
     bool saveMessage(const QString &sender, const QString &receiver, const QString &content,
@@ -29,8 +47,35 @@ public:
                           const QString &currentUser = "", int limit = 100);
     bool clearMessages();
 
+    // 聊天记录分页（服务端）：beforeId>0时取更早的一页，afterId>0时取更新的一页，
+    // 都为0时取最新一页；结果总是按id从新到旧排列
+    QJsonArray getMessagesPage(const QString &currentUser, const QString &target, const QString &messageType,
+                               qint64 beforeId, qint64 afterId, int limit, bool *hasMore = nullptr);
+
+    // 离线消息（服务端）：按id升序取afterId之后的一页，hasMore表示后面还有
+    QJsonArray getOfflineMessagesPage(const QString &username, qint64 afterId, int limit, bool *hasMore = nullptr);
+    // 断线重连（服务端）：afterId之后发给该用户的私聊和所在群的群消息，按id升序一页，不含自己发的
+    QJsonArray getMessagesSince(const QString &username, const QStringList &groupNames, qint64 afterId,
+                                int limit, bool *hasMore = nullptr);
+    // 按固定长度的IN列表分块把整页消息标记为已读，多块时在一个事务中
+    bool markMessagesAsRead(const QList<qint64> &messageIds);
+    static bool markMessagesAsRead(QSqlDatabase &db, const QList<qint64> &messageIds);
+
+    // 用户（服务端）：用户名对应的数字id，不存在时返回0
+    quint32 getUserId(const QString &username);
+
+    // 联系人（服务端）：把该用户加为联系人的所有用户id
+    QList<quint32> getContactOwners(quint32 userId);
+
+    // 群组管理（服务端）
+    QHash<QString, QList<quint32>> getAllGroupMemberships();  // group_name -> user ids
+
 private:
+    // 当前消息表结构版本，对应PRAGMA user_version
+    static constexpr int MessagesSchemaVersion = 2;
+
     QSqlDatabase m_db;
+    bool m_ownsConnection;
 };
 
 #endif // DATABASE_H
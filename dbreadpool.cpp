@@ -0,0 +1,70 @@
+#include "dbreadpool.h"
+#include "sqlitetuning.h"
+#include "sqlstatementcache.h"
+#include <QThread>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+DbReadPool::DbReadPool(const QString &dbPath, int threadCount, QObject *parent)
+    : QObject(parent)
+    , m_dbPath(dbPath)
+{
+    // 线程常驻，每个线程的数据库连接可以一直复用
+    m_pool.setExpiryTimeout(-1);
+    setThreadCount(threadCount);
+}
+
+DbReadPool::~DbReadPool()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+
+    QMutexLocker locker(&m_connectionsMutex);
+    for (const QString &name : qAsConst(m_connectionNames)) {
+        SqlStatementCache::release(name);
+        QSqlDatabase::removeDatabase(name);
+    }
+}
+
+void DbReadPool::setThreadCount(int count)
+{
+    if (count <= 0) {
+        count = qMax(2, QThread::idealThreadCount());
+    }
+    m_pool.setMaxThreadCount(count);
+}
+
+void DbReadPool::start(Task task)
+{
+    m_pool.start([this, task]() {
+        QSqlDatabase db = threadConnection();
+        task(db);
+    });
+}
+
+void DbReadPool::deliver(std::function<void()> continuation)
+{
+    QMetaObject::invokeMethod(this, continuation, Qt::QueuedConnection);
+}
+
+QSqlDatabase DbReadPool::threadConnection()
+{
+    QString name = QString("DbReadPool_%1")
+            .arg(reinterpret_cast<quintptr>(QThread::currentThread()), 0, 16);
+    if (QSqlDatabase::contains(name))
+        return QSqlDatabase::database(name);
+
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", name);
+    db.setDatabaseName(m_dbPath);
+    db.setConnectOptions("QSQLITE_OPEN_READONLY");
+    if (db.open()) {
+        SqliteTuning::applyConnectionPragmas(db);
+    } else {
+        qCritical() << "只读连接无法打开数据库:" << db.lastError().text();
+    }
+
+    QMutexLocker locker(&m_connectionsMutex);
+    m_connectionNames.append(name);
+    return db;
+}
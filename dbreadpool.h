@@ -0,0 +1,42 @@
+#ifndef DBREADPOOL_H
+#define DBREADPOOL_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <functional>
+
+// 只读查询线程池：每个线程持有一个只读打开的SQLite连接，多个查询可以并行执行，
+// 不占用服务器事件循环，也不和消息写线程争用同一个连接。LoginService的凭据校验也跑在一个DbReadPool上
+class DbReadPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<void(QSqlDatabase &db)> Task;
+
+    // threadCount<=0时按CPU核数创建
+    explicit DbReadPool(const QString &dbPath, int threadCount = 0, QObject *parent = nullptr);
+    ~DbReadPool();
+
+    void setThreadCount(int count);
+    int threadCount() const { return m_pool.maxThreadCount(); }
+
+    // 在池中某个线程上执行，task内不要保存db
+    void start(Task task);
+    // 回到DbReadPool所在线程执行，池销毁后尚未执行的回调会被丢弃
+    void deliver(std::function<void()> continuation);
+
+private:
+    QSqlDatabase threadConnection();
+
+    QString m_dbPath;
+    QThreadPool m_pool;
+    QMutex m_connectionsMutex;
+    QStringList m_connectionNames;
+};
+
+#endif // DBREADPOOL_H
@@ -0,0 +1,66 @@
+#include "framedecoder.h"
+#include <QtEndian>
+
+static const int InitialBufferSize = 64 * 1024;
+static const int HeaderSize = static_cast<int>(sizeof(quint32));
+
+FrameDecoder::FrameDecoder(quint32 maxFrameSize)
+    : m_readPos(0)
+    , m_maxFrameSize(maxFrameSize)
+    , m_error(false)
+{
+    // reserve()之后resize(0)不会释放内存，缓冲区可以一直复用
+    m_buffer.reserve(InitialBufferSize);
+}
+
+void FrameDecoder::readFrom(QIODevice *device)
+{
+    // 丢弃已经处理过的帧，未处理的尾部整体前移一次
+    if (m_readPos > 0) {
+        if (m_readPos >= m_buffer.size()) {
+            m_buffer.resize(0);
+        } else {
+            m_buffer.remove(0, m_readPos);
+        }
+        m_readPos = 0;
+    }
+
+    qint64 available = device->bytesAvailable();
+    if (available <= 0)
+        return;
+
+    int oldSize = m_buffer.size();
+    m_buffer.resize(oldSize + static_cast<int>(available));
+    qint64 bytesRead = device->read(m_buffer.data() + oldSize, available);
+    m_buffer.resize(oldSize + static_cast<int>(qMax<qint64>(0, bytesRead)));
+}
+
+bool FrameDecoder::nextFrame(QByteArray *payload)
+{
+    if (m_error)
+        return false;
+
+    int remaining = m_buffer.size() - m_readPos;
+    if (remaining < HeaderSize)
+        return false;
+
+    const char *data = m_buffer.constData() + m_readPos;
+    quint32 messageSize = qFromBigEndian<quint32>(data);
+    if (messageSize > m_maxFrameSize) {
+        m_error = true;
+        return false;
+    }
+    if (static_cast<quint32>(remaining - HeaderSize) < messageSize)
+        return false;
+
+    *payload = QByteArray::fromRawData(data + HeaderSize, static_cast<int>(messageSize));
+    m_readPos += HeaderSize + static_cast<int>(messageSize);
+    return true;
+}
+
+void FrameDecoder::reset()
+{
+    m_buffer.resize(0);
+    m_readPos = 0;
+    m_error = false;
+}
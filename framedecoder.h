@@ -0,0 +1,37 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QByteArray>
+#include <QIODevice>
+
+// 解析“4字节大端长度头 + 数据”格式的帧
+// 每次把设备上所有可读数据读进一块复用的缓冲区，在缓冲区内原地切出各帧，
+// 只在下一次读入前把未处理完的尾部移到开头，避免每帧都复制和移动数据
+class FrameDecoder
+{
+public:
+    static const quint32 DefaultMaxFrameSize = 16 * 1024 * 1024;
+
+    explicit FrameDecoder(quint32 maxFrameSize = DefaultMaxFrameSize);
+
+    void setMaxFrameSize(quint32 size) { m_maxFrameSize = size; }
+    quint32 maxFrameSize() const { return m_maxFrameSize; }
+
+    // 读入设备上当前所有可读数据
+    void readFrom(QIODevice *device);
+    // 取出下一帧。payload直接引用内部缓冲区，只在下一次readFrom()之前有效
+    bool nextFrame(QByteArray *payload);
+
+    // 长度头超过上限时置位，调用方应断开连接
+    bool hasError() const { return m_error; }
+    int bufferedBytes() const { return m_buffer.size() - m_readPos; }
+    void reset();
+
+private:
+    QByteArray m_buffer;
+    int m_readPos;
+    quint32 m_maxFrameSize;
+    bool m_error;
+};
+
+#endif // FRAMEDECODER_H
@@ -0,0 +1,35 @@
+#include "framedmessage.h"
+#include "tracer.h"
+
+FramedMessage FramedMessage::fromJson(const QJsonObject &json)
+{
+    FramedMessage message;
+    message.d = QSharedPointer<Data>::create();
+    message.d->json = json;
+    message.d->traceId = Tracer::currentTrace();
+    return message;
+}
+
+FramedMessage FramedMessage::fromJsonPayload(const QByteArray &payload)
+{
+    FramedMessage message;
+    message.d = QSharedPointer<Data>::create();
+    message.d->packets[WireCodec::Json] = WireCodec::frame(payload);
+    message.d->traceId = Tracer::currentTrace();
+    return message;
+}
+
+QByteArray FramedMessage::packet(WireCodec::Encoding encoding) const
+{
+    if (!d)
+        return QByteArray();
+
+    QByteArray &packet = d->packets[encoding];
+    if (packet.isEmpty()) {
+        if (d->json.isEmpty() && !d->packets[WireCodec::Json].isEmpty()) {
+            WireCodec::decode(d->packets[WireCodec::Json].mid(4), &d->json);
+        }
+        packet = WireCodec::frame(WireCodec::encode(d->json, encoding));
+    }
+    return packet;
+}
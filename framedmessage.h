@@ -0,0 +1,36 @@
+#ifndef FRAMEDMESSAGE_H
+#define FRAMEDMESSAGE_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QSharedPointer>
+#include "wirecodec.h"
+
+// 已经编码好的一帧数据：4字节大端长度头 + 数据
+// 每种编码只在第一次用到时编码一次，群发时所有接收者共享同一份隐式共享的QByteArray
+// packet()会缓存结果，不是线程安全的，应在构造它的线程中调用
+class FramedMessage
+{
+public:
+    FramedMessage() = default;
+
+    static FramedMessage fromJson(const QJsonObject &json);
+    // 已经是JSON文本的数据（转发快速通道），JSON编码直接使用，其他编码时才解析
+    static FramedMessage fromJsonPayload(const QByteArray &payload);
+
+    QByteArray packet(WireCodec::Encoding encoding = WireCodec::Json) const;
+    bool isEmpty() const { return !d; }
+    // 构造时线程上的当前trace id（见Tracer::Scope），写socket时据此记录区间
+    quint64 traceId() const { return d ? d->traceId : 0; }
+
+private:
+    struct Data {
+        QJsonObject json;
+        QByteArray packets[2];  // 按WireCodec::Encoding索引
+        quint64 traceId = 0;
+    };
+
+    QSharedPointer<Data> d;
+};
+
+#endif // FRAMEDMESSAGE_H
@@ -0,0 +1,55 @@
+#include "groupindex.h"
+
+void GroupIndex::load(const QHash<QString, QList<quint32>> &memberships)
+{
+    clear();
+    for (auto it = memberships.constBegin(); it != memberships.constEnd(); ++it) {
+        for (quint32 userId : it.value()) {
+            addMember(it.key(), userId, false);
+        }
+    }
+}
+
+void GroupIndex::clear()
+{
+    m_members.clear();
+    m_userGroups.clear();
+    m_onlineMembers.clear();
+}
+
+void GroupIndex::addMember(const QString &groupName, quint32 userId, bool online)
+{
+    m_members[groupName].insert(userId);
+    m_userGroups[userId].insert(groupName);
+    if (online) {
+        m_onlineMembers[groupName].insert(userId);
+    }
+}
+
+void GroupIndex::userOnline(quint32 userId)
+{
+    const QSet<QString> groups = m_userGroups.value(userId);
+    for (const QString &groupName : groups) {
+        m_onlineMembers[groupName].insert(userId);
+    }
+}
+
+void GroupIndex::userOffline(quint32 userId)
+{
+    const QSet<QString> groups = m_userGroups.value(userId);
+    for (const QString &groupName : groups) {
+        auto it = m_onlineMembers.find(groupName);
+        if (it == m_onlineMembers.end())
+            continue;
+        it.value().remove(userId);
+        if (it.value().isEmpty()) {
+            m_onlineMembers.erase(it);
+        }
+    }
+}
+
+bool GroupIndex::isMember(const QString &groupName, quint32 userId) const
+{
+    auto it = m_members.constFind(groupName);
+    return it != m_members.constEnd() && it.value().contains(userId);
+}
@@ -0,0 +1,31 @@
+#ifndef GROUPINDEX_H
+#define GROUPINDEX_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QList>
+
+// 群成员关系的内存索引（成员用数字用户id表示），启动时从数据库加载，之后随建群/入群/拉人更新
+// 额外维护每个群当前在线的成员，群消息只需要遍历在线成员
+class GroupIndex
+{
+public:
+    void load(const QHash<QString, QList<quint32>> &memberships);
+    void clear();
+
+    void addMember(const QString &groupName, quint32 userId, bool online);
+    void userOnline(quint32 userId);
+    void userOffline(quint32 userId);
+
+    bool isMember(const QString &groupName, quint32 userId) const;
+    QSet<quint32> onlineMembers(const QString &groupName) const { return m_onlineMembers.value(groupName); }
+    QSet<QString> groupsOf(quint32 userId) const { return m_userGroups.value(userId); }
+
+private:
+    QHash<QString, QSet<quint32>> m_members;        // group -> members
+    QHash<quint32, QSet<QString>> m_userGroups;     // user -> groups
+    QHash<QString, QSet<quint32>> m_onlineMembers;  // group -> online members
+};
+
+#endif // GROUPINDEX_H
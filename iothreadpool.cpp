@@ -0,0 +1,71 @@
+#include "iothreadpool.h"
+#include <QDebug>
+
+IoThreadPool::IoThreadPool(int threadCount, QObject *parent)
+    : QObject(parent)
+    , m_policy(LeastLoaded)
+    , m_nextIndex(0)
+{
+    // 默认每个CPU核心一个线程
+    if (threadCount <= 0) {
+        threadCount = qMax(1, QThread::idealThreadCount());
+    }
+
+    for (int i = 0; i < threadCount; ++i) {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QString("ChatIO-%1").arg(i));
+        thread->start();
+        m_threads.append(thread);
+        m_loads.append(0);
+    }
+}
+
+IoThreadPool::~IoThreadPool()
+{
+    stop();
+}
+
+int IoThreadPool::assign(QObject *object)
+{
+    int index = pickThread();
+    QThread *thread = m_threads[index];
+
+    object->moveToThread(thread);
+    ++m_loads[index];
+
+    // 对象在I/O线程中被销毁时，计数的更新会排队回到本线程
+    connect(object, &QObject::destroyed, this, [this, index]() {
+        --m_loads[index];
+    });
+    // 线程退出时清理仍然留在上面的对象
+    connect(thread, &QThread::finished, object, &QObject::deleteLater);
+
+    return index;
+}
+
+void IoThreadPool::stop()
+{
+    for (QThread *thread : m_threads) {
+        thread->quit();
+    }
+    for (QThread *thread : m_threads) {
+        thread->wait();
+    }
+}
+
+int IoThreadPool::pickThread()
+{
+    if (m_policy == RoundRobin) {
+        int index = m_nextIndex;
+        m_nextIndex = (m_nextIndex + 1) % m_threads.size();
+        return index;
+    }
+
+    int best = 0;
+    for (int i = 1; i < m_loads.size(); ++i) {
+        if (m_loads[i] < m_loads[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,41 @@
+#ifndef IOTHREADPOOL_H
+#define IOTHREADPOOL_H
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+
+// 一组常驻的I/O线程，每个客户端连接（ServerWorker）被分配到其中一个线程上
+// 完成socket读写和JSON解析，避免所有连接都挤在服务器的GUI线程上
+class IoThreadPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Policy {
+        RoundRobin,   // 轮询分配
+        LeastLoaded   // 分配给当前连接数最少的线程
+    };
+
+    explicit IoThreadPool(int threadCount = 0, QObject *parent = nullptr);
+    ~IoThreadPool();
+
+    void setPolicy(Policy policy) { m_policy = policy; }
+    Policy policy() const { return m_policy; }
+    int threadCount() const { return m_threads.size(); }
+    int load(int index) const { return m_loads.value(index); }
+
+    // 选择一个线程并把对象迁移过去，返回线程索引；对象必须没有parent
+    int assign(QObject *object);
+    void stop();
+
+private:
+    int pickThread();
+
+    QVector<QThread*> m_threads;
+    QVector<int> m_loads;  // 每个线程上的对象数
+    Policy m_policy;
+    int m_nextIndex;
+};
+
+#endif // IOTHREADPOOL_H
@@ -0,0 +1,329 @@
+#include "loadbot.h"
+#include <QJsonArray>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QtMath>
+
+void LoadStats::merge(const LoadStats &other)
+{
+    privateSent += other.privateSent;
+    groupSent += other.groupSent;
+    privateReceived += other.privateReceived;
+    groupReceived += other.groupReceived;
+    offlineReceived += other.offlineReceived;
+    acks += other.acks;
+    logins += other.logins;
+    loginFailures += other.loginFailures;
+    connectErrors += other.connectErrors;
+    socketErrors += other.socketErrors;
+    unexpectedDisconnects += other.unexpectedDisconnects;
+    latenciesUs += other.latenciesUs;
+}
+
+qint64 LoadBot::nowUs()
+{
+    static QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed() / 1000;
+}
+
+LoadBot::LoadBot(int index, const LoadConfig &config, QObject *parent)
+    : QObject(parent)
+    , m_index(index)
+    , m_config(config)
+    , m_username(QString("%1%2").arg(config.userPrefix).arg(index))
+    , m_socket(new QTcpSocket(this))
+    , m_encoding(WireCodec::Json)
+    , m_state(Idle)
+    // 与ChatClient一样随机起始，重启压测进程时不会被服务器当成重发的消息
+    , m_clientId(static_cast<qint64>(QRandomGenerator::global()->generate64() >> 12))
+    , m_privateTimer(new QTimer(this))
+    , m_groupTimer(new QTimer(this))
+    , m_churnTimer(new QTimer(this))
+{
+    if (config.groups > 0) {
+        m_groups << QString("%1_group_%2").arg(config.userPrefix).arg(index % config.groups);
+    }
+
+    m_privateTimer->setSingleShot(true);
+    m_groupTimer->setSingleShot(true);
+    m_churnTimer->setInterval(1000);
+
+    connect(m_socket, &QTcpSocket::connected, this, &LoadBot::onConnected);
+    connect(m_socket, &QTcpSocket::disconnected, this, &LoadBot::onDisconnected);
+    connect(m_socket, &QTcpSocket::readyRead, this, &LoadBot::onReadyRead);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    connect(m_socket, &QAbstractSocket::errorOccurred, this, &LoadBot::onError);
+#else
+    connect(m_socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error),
+            this, &LoadBot::onError);
+#endif
+    connect(m_privateTimer, &QTimer::timeout, this, &LoadBot::sendPrivate);
+    connect(m_groupTimer, &QTimer::timeout, this, &LoadBot::sendGroup);
+    connect(m_churnTimer, &QTimer::timeout, this, &LoadBot::maybeChurn);
+}
+
+void LoadBot::start()
+{
+    if (m_state == Stopped)
+        return;
+
+    m_decoder.reset();
+    m_encoding = WireCodec::Json;
+    m_state = Connecting;
+    m_socket->connectToHost(m_config.host, m_config.port);
+}
+
+void LoadBot::stop()
+{
+    m_state = Stopped;
+    m_privateTimer->stop();
+    m_groupTimer->stop();
+    m_churnTimer->stop();
+    m_socket->abort();
+}
+
+void LoadBot::onConnected()
+{
+    // 与ChatClient一样，先用JSON发送编码协商
+    if (m_config.cbor) {
+        QJsonObject hello;
+        hello["type"] = "hello";
+        hello["encodings"] = QJsonArray{ "cbor", "json" };
+        send(hello);
+    }
+
+    if (m_config.registerUsers && m_stats.logins == 0) {
+        m_state = Registering;
+        QJsonObject registerMsg;
+        registerMsg["type"] = "register";
+        registerMsg["username"] = m_username;
+        registerMsg["password"] = m_config.password;
+        registerMsg["nickname"] = m_username;
+        send(registerMsg);
+    } else {
+        login();
+    }
+}
+
+void LoadBot::login()
+{
+    m_state = LoggingIn;
+    QJsonObject loginMsg;
+    loginMsg["type"] = "login";
+    loginMsg["username"] = m_username;
+    loginMsg["password"] = m_config.password;
+    loginMsg["bootstrap"] = true;
+    send(loginMsg);
+}
+
+void LoadBot::onDisconnected()
+{
+    m_privateTimer->stop();
+    m_groupTimer->stop();
+    m_churnTimer->stop();
+
+    if (m_state == Stopped || m_state == Offline)
+        return;
+
+    // 不是自己主动下线的断开，稍后重连
+    ++m_stats.unexpectedDisconnects;
+    m_state = Offline;
+    QTimer::singleShot(m_config.offlineMs, this, &LoadBot::start);
+}
+
+void LoadBot::onError(QAbstractSocket::SocketError socketError)
+{
+    if (m_state == Stopped || m_state == Offline)
+        return;
+
+    if (m_state == Connecting) {
+        ++m_stats.connectErrors;
+        m_state = Offline;
+        QTimer::singleShot(m_config.offlineMs, this, &LoadBot::start);
+        return;
+    }
+
+    if (socketError != QAbstractSocket::RemoteHostClosedError) {
+        ++m_stats.socketErrors;
+    }
+}
+
+void LoadBot::onReadyRead()
+{
+    m_decoder.readFrom(m_socket);
+
+    QByteArray payload;
+    QJsonObject json;
+    while (m_decoder.nextFrame(&payload)) {
+        if (WireCodec::decode(payload, &json)) {
+            handleMessage(json);
+        }
+    }
+
+    if (m_decoder.hasError()) {
+        ++m_stats.socketErrors;
+        m_socket->abort();
+    }
+}
+
+void LoadBot::handleMessage(const QJsonObject &json)
+{
+    QString type = json["type"].toString();
+
+    if (type == "private_message" || type == "group_message") {
+        if (json["sender"].toString() == m_username)
+            return;
+        if (type == "private_message") {
+            ++m_stats.privateReceived;
+        } else {
+            ++m_stats.groupReceived;
+        }
+        recordLatency(json["content"].toString());
+    } else if (type == "ack") {
+        m_stats.acks += json["acks"].toArray().size();
+    } else if (type == "bootstrap" || type == "login_success") {
+        ++m_stats.logins;
+        if (json.contains("offline")) {
+            handleMessage(json["offline"].toObject());
+        }
+        goOnline();
+    } else if (type == "offline_messages") {
+        m_stats.offlineReceived += json["messages"].toArray().size();
+        QJsonObject ack;
+        ack["type"] = "offline_ack";
+        ack["cursor"] = json["cursor"];
+        send(ack);
+    } else if (type == "login_failed") {
+        ++m_stats.loginFailures;
+        stop();
+    } else if (type == "register_success" || type == "register_failed") {
+        login();
+    } else if (type == "hello_ack") {
+        WireCodec::encodingFromName(json["encoding"].toString(), &m_encoding);
+    }
+}
+
+void LoadBot::goOnline()
+{
+    m_state = Online;
+
+    // 第一次上线时建群或入群，群已存在或已是成员时服务器返回失败，不影响压测
+    if (m_stats.logins == 1) {
+        for (const QString &groupName : qAsConst(m_groups)) {
+            QJsonObject create;
+            create["type"] = "create_group";
+            create["group_name"] = groupName;
+            send(create);
+
+            QJsonObject join;
+            join["type"] = "join_group";
+            join["group_name"] = groupName;
+            send(join);
+        }
+    }
+
+    if (m_config.privateRate > 0 && m_config.users > 1)
+        m_privateTimer->start(nextInterval(m_config.privateRate));
+    if (m_config.groupRate > 0 && !m_groups.isEmpty())
+        m_groupTimer->start(nextInterval(m_config.groupRate));
+    if (m_config.churnRate > 0)
+        m_churnTimer->start();
+}
+
+void LoadBot::goOffline()
+{
+    m_state = Offline;
+    m_privateTimer->stop();
+    m_groupTimer->stop();
+    m_churnTimer->stop();
+    m_socket->disconnectFromHost();
+    QTimer::singleShot(m_config.offlineMs, this, &LoadBot::start);
+}
+
+void LoadBot::maybeChurn()
+{
+    if (QRandomGenerator::global()->generateDouble() < m_config.churnRate) {
+        goOffline();
+    }
+}
+
+void LoadBot::sendPrivate()
+{
+    if (m_state != Online)
+        return;
+
+    // 随机选一个其他用户
+    int target = QRandomGenerator::global()->bounded(m_config.users - 1);
+    if (target >= m_index)
+        ++target;
+
+    QJsonObject message;
+    message["type"] = "private_message";
+    message["receiver"] = QString("%1%2").arg(m_config.userPrefix).arg(target);
+    message["content"] = makeContent();
+    message["client_id"] = ++m_clientId;
+    send(message);
+    ++m_stats.privateSent;
+
+    m_privateTimer->start(nextInterval(m_config.privateRate));
+}
+
+void LoadBot::sendGroup()
+{
+    if (m_state != Online)
+        return;
+
+    QJsonObject message;
+    message["type"] = "group_message";
+    message["group_name"] = m_groups.first();
+    message["content"] = makeContent();
+    message["client_id"] = ++m_clientId;
+    send(message);
+    ++m_stats.groupSent;
+
+    m_groupTimer->start(nextInterval(m_config.groupRate));
+}
+
+void LoadBot::send(const QJsonObject &json)
+{
+    if (m_socket->state() != QAbstractSocket::ConnectedState)
+        return;
+    m_socket->write(WireCodec::frame(WireCodec::encode(json, m_encoding)));
+}
+
+QString LoadBot::makeContent()
+{
+    // 格式："lg:<发送时刻微秒>:" + 填充到指定长度
+    QString content = QString("lg:%1:").arg(nowUs());
+    if (content.size() < m_config.payloadBytes) {
+        content.append(QString(m_config.payloadBytes - content.size(), QLatin1Char('x')));
+    }
+    return content;
+}
+
+void LoadBot::recordLatency(const QString &content)
+{
+    if (!content.startsWith("lg:"))
+        return;
+
+    int end = content.indexOf(':', 3);
+    if (end < 0)
+        return;
+
+    bool ok = false;
+    qint64 sentUs = content.mid(3, end - 3).toLongLong(&ok);
+    if (ok) {
+        m_stats.latenciesUs.append(nowUs() - sentUs);
+    }
+}
+
+int LoadBot::nextInterval(double ratePerSecond)
+{
+    // 指数分布的间隔，发送过程近似泊松过程，避免所有机器人同时发送
+    double u = 1.0 - QRandomGenerator::global()->generateDouble();
+    return qMax(1, static_cast<int>(-qLn(u) / ratePerSecond * 1000.0));
+}
@@ -0,0 +1,117 @@
+#ifndef LOADBOT_H
+#define LOADBOT_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QJsonObject>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include "wirecodec.h"
+#include "framedecoder.h"
+
+// 压测参数，所有机器人共用
+struct LoadConfig {
+    QHostAddress host = QHostAddress::LocalHost;
+    quint16 port = 8888;
+    int users = 1000;
+    int threads = 1;
+    int rampPerSecond = 200;     // 每秒新建的连接数
+    int durationSecs = 60;
+    double privateRate = 0.2;    // 每个用户每秒发送的私聊条数
+    double groupRate = 0.05;     // 每个用户每秒发送的群聊条数
+    int groups = 10;
+    int payloadBytes = 64;
+    double churnRate = 0.0;      // 每个用户每秒下线的概率
+    int offlineMs = 2000;        // 下线后多久重新上线
+    bool registerUsers = false;  // 登录前先注册，用户已存在时注册失败不影响登录
+    bool cbor = false;
+    QString userPrefix = "bot";
+    QString password = "bot";
+};
+
+// 机器人各自累计的统计，压测结束后汇总，运行期间不跨线程访问
+struct LoadStats {
+    quint64 privateSent = 0;
+    quint64 groupSent = 0;
+    quint64 privateReceived = 0;
+    quint64 groupReceived = 0;
+    quint64 offlineReceived = 0;
+    quint64 acks = 0;
+    quint64 logins = 0;
+    quint64 loginFailures = 0;
+    quint64 connectErrors = 0;
+    quint64 socketErrors = 0;
+    quint64 unexpectedDisconnects = 0;
+    QVector<qint64> latenciesUs;  // 端到端投递延迟（微秒），只统计实时收到的消息
+
+    void merge(const LoadStats &other);
+};
+
+// 一个模拟用户：按ChatClient的协议连接、登录、入群、按速率发消息，并随机下线再上线。
+// 消息内容开头带发送时刻，接收方用同一进程内的单调时钟算出投递延迟
+class LoadBot : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadBot(int index, const LoadConfig &config, QObject *parent = nullptr);
+
+    const LoadStats &stats() const { return m_stats; }
+    QString username() const { return m_username; }
+
+    // 进程内所有机器人共用的单调时钟（微秒）
+    static qint64 nowUs();
+
+public slots:
+    void start();
+    void stop();
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onError(QAbstractSocket::SocketError socketError);
+    void onReadyRead();
+    void sendPrivate();
+    void sendGroup();
+    void maybeChurn();
+
+private:
+    enum State {
+        Idle,
+        Connecting,
+        Registering,
+        LoggingIn,
+        Online,
+        Offline,
+        Stopped
+    };
+
+    void send(const QJsonObject &json);
+    void handleMessage(const QJsonObject &json);
+    void login();
+    void goOnline();
+    void goOffline();
+    QString makeContent();
+    void recordLatency(const QString &content);
+    int nextInterval(double ratePerSecond);
+
+    int m_index;
+    LoadConfig m_config;
+    QString m_username;
+    QStringList m_groups;  // 本机器人所在的群
+    QTcpSocket *m_socket;
+    FrameDecoder m_decoder;
+    WireCodec::Encoding m_encoding;
+    State m_state;
+    qint64 m_clientId;
+
+    // 必须是本对象的子对象，moveToThread时才会一起移到工作线程
+    QTimer *m_privateTimer;
+    QTimer *m_groupTimer;
+    QTimer *m_churnTimer;
+    LoadStats m_stats;
+};
+
+#endif // LOADBOT_H
@@ -0,0 +1,217 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <QtMath>
+#include <algorithm>
+#include <cstdio>
+#include "loadbot.h"
+
+// 压测客户端：在一个进程里启动大量机器人连接ChatServer，结束后以JSON输出吞吐、延迟分位数和错误数
+
+static double percentileMs(const QVector<qint64> &sorted, double q)
+{
+    if (sorted.isEmpty())
+        return 0.0;
+    int rank = qBound(0, static_cast<int>(qCeil(q * sorted.size())) - 1, sorted.size() - 1);
+    return sorted.at(rank) / 1000.0;
+}
+
+static QJsonObject buildReport(const LoadConfig &config, const LoadStats &stats, double elapsedSecs)
+{
+    QVector<qint64> latencies = stats.latenciesUs;
+    std::sort(latencies.begin(), latencies.end());
+
+    QJsonObject configObj;
+    configObj["users"] = config.users;
+    configObj["threads"] = config.threads;
+    configObj["duration_secs"] = config.durationSecs;
+    configObj["private_rate"] = config.privateRate;
+    configObj["group_rate"] = config.groupRate;
+    configObj["groups"] = config.groups;
+    configObj["payload_bytes"] = config.payloadBytes;
+    configObj["churn_rate"] = config.churnRate;
+    configObj["encoding"] = config.cbor ? "cbor" : "json";
+
+    QJsonObject sent;
+    sent["private"] = static_cast<double>(stats.privateSent);
+    sent["group"] = static_cast<double>(stats.groupSent);
+    sent["acks"] = static_cast<double>(stats.acks);
+
+    QJsonObject received;
+    received["private"] = static_cast<double>(stats.privateReceived);
+    received["group"] = static_cast<double>(stats.groupReceived);
+    received["offline"] = static_cast<double>(stats.offlineReceived);
+
+    quint64 totalSent = stats.privateSent + stats.groupSent;
+    quint64 totalReceived = stats.privateReceived + stats.groupReceived;
+    QJsonObject throughput;
+    throughput["sent_per_sec"] = elapsedSecs > 0 ? totalSent / elapsedSecs : 0.0;
+    throughput["delivered_per_sec"] = elapsedSecs > 0 ? totalReceived / elapsedSecs : 0.0;
+
+    QJsonObject latency;
+    latency["samples"] = latencies.size();
+    latency["p50"] = percentileMs(latencies, 0.50);
+    latency["p99"] = percentileMs(latencies, 0.99);
+    latency["p999"] = percentileMs(latencies, 0.999);
+    latency["max"] = latencies.isEmpty() ? 0.0 : latencies.last() / 1000.0;
+
+    QJsonObject errors;
+    errors["connect"] = static_cast<double>(stats.connectErrors);
+    errors["socket"] = static_cast<double>(stats.socketErrors);
+    errors["unexpected_disconnects"] = static_cast<double>(stats.unexpectedDisconnects);
+    errors["login_failures"] = static_cast<double>(stats.loginFailures);
+
+    QJsonObject report;
+    report["config"] = configObj;
+    report["elapsed_secs"] = elapsedSecs;
+    report["logins"] = static_cast<double>(stats.logins);
+    report["sent"] = sent;
+    report["received"] = received;
+    report["throughput"] = throughput;
+    report["latency_ms"] = latency;
+    report["errors"] = errors;
+    return report;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("ChatLoadGen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("ChatServer load generator");
+    parser.addHelpOption();
+
+    QCommandLineOption hostOption("host", "Server address.", "address", "127.0.0.1");
+    QCommandLineOption portOption("port", "Server port.", "port", "8888");
+    QCommandLineOption usersOption("users", "Number of simulated users.", "count", "1000");
+    QCommandLineOption threadsOption("threads", "Number of client threads.", "count",
+                                     QString::number(qMax(1, QThread::idealThreadCount())));
+    QCommandLineOption rampOption("ramp", "New connections per second.", "count", "200");
+    QCommandLineOption durationOption("duration", "Test duration in seconds, starting after ramp-up.", "secs", "60");
+    QCommandLineOption privateRateOption("private-rate", "Private messages per user per second.", "rate", "0.2");
+    QCommandLineOption groupRateOption("group-rate", "Group messages per user per second.", "rate", "0.05");
+    QCommandLineOption groupsOption("groups", "Number of groups the users are spread over.", "count", "10");
+    QCommandLineOption payloadOption("payload", "Message content size in bytes.", "bytes", "64");
+    QCommandLineOption churnOption("churn", "Probability per user per second of going offline.", "rate", "0");
+    QCommandLineOption offlineOption("offline-ms", "How long a user stays offline before reconnecting.", "ms", "2000");
+    QCommandLineOption registerOption("register", "Register the users before logging in.");
+    QCommandLineOption cborOption("cbor", "Negotiate CBOR encoding.");
+    QCommandLineOption prefixOption("prefix", "Username prefix.", "prefix", "bot");
+    QCommandLineOption passwordOption("password", "Password for all users.", "password", "bot");
+    QCommandLineOption outputOption({"o", "output"}, "Write the JSON report to a file instead of stdout.", "file");
+
+    parser.addOptions({ hostOption, portOption, usersOption, threadsOption, rampOption, durationOption,
+                        privateRateOption, groupRateOption, groupsOption, payloadOption, churnOption,
+                        offlineOption, registerOption, cborOption, prefixOption, passwordOption, outputOption });
+    parser.process(app);
+
+    LoadConfig config;
+    config.host = QHostAddress(parser.value(hostOption));
+    config.port = static_cast<quint16>(parser.value(portOption).toUInt());
+    config.users = qMax(1, parser.value(usersOption).toInt());
+    config.threads = qMax(1, parser.value(threadsOption).toInt());
+    config.rampPerSecond = qMax(1, parser.value(rampOption).toInt());
+    config.durationSecs = qMax(1, parser.value(durationOption).toInt());
+    config.privateRate = parser.value(privateRateOption).toDouble();
+    config.groupRate = parser.value(groupRateOption).toDouble();
+    config.groups = qMax(0, parser.value(groupsOption).toInt());
+    config.payloadBytes = qMax(0, parser.value(payloadOption).toInt());
+    config.churnRate = parser.value(churnOption).toDouble();
+    config.offlineMs = qMax(0, parser.value(offlineOption).toInt());
+    config.registerUsers = parser.isSet(registerOption);
+    config.cbor = parser.isSet(cborOption);
+    config.userPrefix = parser.value(prefixOption);
+    config.password = parser.value(passwordOption);
+
+    if (config.host.isNull()) {
+        fprintf(stderr, "Invalid host address: %s\n", qPrintable(parser.value(hostOption)));
+        return 1;
+    }
+
+    // 机器人按编号轮流分到各个线程，每个线程一个事件循环
+    QVector<QThread *> threads;
+    for (int i = 0; i < config.threads; ++i) {
+        QThread *thread = new QThread(&app);
+        thread->start();
+        threads.append(thread);
+    }
+
+    QVector<LoadBot *> bots;
+    bots.reserve(config.users);
+    for (int i = 0; i < config.users; ++i) {
+        LoadBot *bot = new LoadBot(i, config);
+        QThread *thread = threads.at(i % threads.size());
+        bot->moveToThread(thread);
+        QObject::connect(thread, &QThread::finished, bot, &QObject::deleteLater);
+        bots.append(bot);
+    }
+
+    // 分批启动，按ramp控制建连速度，批间隔不小于10ms
+    const int batchSize = qMax(1, config.rampPerSecond / 100);
+    int started = 0;
+    QElapsedTimer elapsed;
+    QTimer rampTimer;
+    rampTimer.setInterval(qMax(1, 1000 * batchSize / config.rampPerSecond));
+
+    QTimer stopTimer;
+    stopTimer.setSingleShot(true);
+    stopTimer.setInterval(config.durationSecs * 1000);
+
+    QObject::connect(&rampTimer, &QTimer::timeout, [&]() {
+        for (int i = 0; i < batchSize && started < bots.size(); ++i, ++started) {
+            QMetaObject::invokeMethod(bots.at(started), &LoadBot::start, Qt::QueuedConnection);
+        }
+        if (started >= bots.size()) {
+            rampTimer.stop();
+            fprintf(stderr, "All %d users started, running for %d s\n", started, config.durationSecs);
+            stopTimer.start();
+        }
+    });
+
+    QObject::connect(&stopTimer, &QTimer::timeout, [&]() {
+        double elapsedSecs = elapsed.nsecsElapsed() / 1e9;
+
+        // 在各自线程里停下机器人，之后再读统计就不会和收发并发
+        for (LoadBot *bot : qAsConst(bots)) {
+            QMetaObject::invokeMethod(bot, &LoadBot::stop, Qt::BlockingQueuedConnection);
+        }
+
+        LoadStats total;
+        for (LoadBot *bot : qAsConst(bots)) {
+            total.merge(bot->stats());
+        }
+        QByteArray report = QJsonDocument(buildReport(config, total, elapsedSecs)).toJson(QJsonDocument::Indented);
+
+        if (parser.isSet(outputOption)) {
+            QFile file(parser.value(outputOption));
+            if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                file.write(report);
+            } else {
+                fprintf(stderr, "Cannot write %s: %s\n", qPrintable(file.fileName()), qPrintable(file.errorString()));
+            }
+        } else {
+            fwrite(report.constData(), 1, report.size(), stdout);
+            fflush(stdout);
+        }
+
+        for (QThread *thread : qAsConst(threads)) {
+            thread->quit();
+            thread->wait();
+        }
+        app.quit();
+    });
+
+    fprintf(stderr, "Starting %d users against %s:%u on %d threads\n", config.users,
+            qPrintable(config.host.toString()), config.port, config.threads);
+    // 吞吐按整个压测时间（含建连阶段）计算
+    elapsed.start();
+    rampTimer.start();
+    return app.exec();
+}
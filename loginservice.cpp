@@ -0,0 +1,110 @@
+#include "loginservice.h"
+#include "messagestore.h"
+#include "sqlstatementcache.h"
+#include <QThread>
+#include <QSharedPointer>
+#include <QCryptographicHash>
+#include <QSqlQuery>
+
+LoginService::LoginService(const QString &dbPath, QObject *parent)
+    : QObject(parent)
+    , m_writer(nullptr)
+    , m_maxQueued(1024)
+    , m_queued(0)
+    , m_active(0)
+    , m_rejected(0)
+    , m_pool(dbPath, qMax(1, QThread::idealThreadCount() / 2))
+{
+}
+
+void LoginService::setMaxConcurrent(int count)
+{
+    m_pool.setThreadCount(qMax(1, count));
+}
+
+bool LoginService::authenticate(const QString &username, const QString &password, AuthCallback done)
+{
+    // 由池线程写入，排队回到本线程后才读取
+    QSharedPointer<quint32> userId(new quint32(0));
+    return submit([username, password, userId](QSqlDatabase &db) {
+        SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(db)->prepare(
+                    "get_password", "SELECT id, password FROM users WHERE username = ?");
+        statement.query.addBindValue(username);
+        if (!statement.exec() || !statement.query.next())
+            return false;
+        quint32 id = statement.query.value(0).toUInt();
+        QString stored = statement.query.value(1).toString();
+        statement.query.finish();
+        if (!verifyPassword(stored, password))
+            return false;
+        *userId = id;
+        return true;
+    }, [done, userId](bool ok) {
+        done(ok, ok ? *userId : 0);
+    });
+}
+
+bool LoginService::createUser(const QString &username, const QString &password, const QString &nickname,
+                              Callback done)
+{
+    MessageStore *writer = m_writer;
+    return submit([username, password, nickname, writer](QSqlDatabase &) {
+        // 哈希仍在登录线程上计算，写线程只做INSERT
+        QString hash = hashPassword(password);
+        MessageStore::WriteJob insert = [username, hash, nickname](QSqlDatabase &writeDb) {
+            SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(writeDb)->prepare(
+                        "create_user", "INSERT INTO users (username, password, nickname) VALUES (?, ?, ?)");
+            statement.query.addBindValue(username);
+            statement.query.addBindValue(hash);
+            statement.query.addBindValue(nickname);
+            // 用户名重复时违反唯一约束，插入失败
+            return statement.exec();
+        };
+        return writer && writer->execute(insert);
+    }, done);
+}
+
+bool LoginService::verifyPassword(const QString &stored, const QString &supplied)
+{
+    QByteArray expected = stored.trimmed().toLower().toLatin1();
+    QByteArray actual = hashPassword(supplied).toLatin1();
+    if (expected.size() != actual.size())
+        return false;
+
+    // 逐字节比较到底，耗时与第一个不同字节的位置无关
+    unsigned char diff = 0;
+    for (int i = 0; i < actual.size(); ++i) {
+        diff |= static_cast<unsigned char>(expected.at(i) ^ actual.at(i));
+    }
+    return diff == 0;
+}
+
+QString LoginService::hashPassword(const QString &password)
+{
+    // 与users表中已有的密码一致：UTF-8的SHA-256，小写十六进制
+    return QString::fromLatin1(QCryptographicHash::hash(password.toUtf8(), QCryptographicHash::Sha256).toHex());
+}
+
+bool LoginService::submit(Job job, Callback done)
+{
+    if (m_queued.loadAcquire() >= m_maxQueued) {
+        m_rejected.fetchAndAddRelaxed(1);
+        return false;
+    }
+    m_queued.fetchAndAddRelaxed(1);
+
+    m_pool.start([this, job, done](QSqlDatabase &db) {
+        m_queued.fetchAndAddRelaxed(-1);
+        m_active.fetchAndAddRelaxed(1);
+
+        bool ok = db.isOpen() && job(db);
+
+        m_active.fetchAndAddRelaxed(-1);
+
+        // 回到LoginService所在线程执行后续处理；池析构时会等待所有任务结束
+        m_pool.deliver([done, ok]() {
+            done(ok);
+        });
+    });
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef LOGINSERVICE_H
+#define LOGINSERVICE_H
+
+#include <QObject>
+#include <QString>
+#include <QAtomicInteger>
+#include <QSqlDatabase>
+#include <functional>
+#include "dbreadpool.h"
+
+class MessageStore;
+
+// 登录/注册的凭据校验放到有界线程池里执行，慢速的密码哈希不会卡住服务器事件循环。
+// 任务在自己的DbReadPool上执行，每个线程一个只读连接；结果以排队调用的方式回到LoginService所在线程
+class LoginService : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<void(bool ok)> Callback;
+    // 校验通过时带回users.id，事件循环上不必再查一次
+    typedef std::function<void(bool ok, quint32 userId)> AuthCallback;
+
+    explicit LoginService(const QString &dbPath, QObject *parent = nullptr);
+
+    // 注册用户的INSERT交给MessageStore的写线程，本服务的连接只读；没有设置时注册总是失败
+    void setWriter(MessageStore *writer) { m_writer = writer; }
+
+    // 同时进行校验的最大数量（即线程池大小）
+    void setMaxConcurrent(int count);
+    int maxConcurrent() const { return m_pool.threadCount(); }
+    // 排队等待的请求超过该值时直接拒绝
+    void setMaxQueued(int count) { m_maxQueued = qMax(0, count); }
+    int maxQueued() const { return m_maxQueued; }
+
+    int queueDepth() const { return m_queued.loadAcquire(); }   // 已提交、尚未开始
+    int activeCount() const { return m_active.loadAcquire(); }  // 正在校验
+    quint64 rejectedCount() const { return m_rejected.loadAcquire(); }
+
+    // 返回false表示队列已满，done不会被调用
+    bool authenticate(const QString &username, const QString &password, AuthCallback done);
+    bool createUser(const QString &username, const QString &password, const QString &nickname,
+                    Callback done);
+
+    // 密码存为SHA-256十六进制，按常量时间比较；换成慢速哈希时只需修改这里和hashPassword
+    static bool verifyPassword(const QString &stored, const QString &supplied);
+    static QString hashPassword(const QString &password);
+
+private:
+    typedef std::function<bool(QSqlDatabase &db)> Job;
+
+    bool submit(Job job, Callback done);
+
+    MessageStore *m_writer;
+    int m_maxQueued;
+    QAtomicInteger<int> m_queued;
+    QAtomicInteger<int> m_active;
+    QAtomicInteger<quint64> m_rejected;
+    // 放在计数器之后：先析构，等池中任务结束后计数器才销毁
+    DbReadPool m_pool;
+};
+
+#endif // LOGINSERVICE_H
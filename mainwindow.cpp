@@ -16,6 +16,9 @@ MainWindow::MainWindow(QWidget *parent)
     , ui(new Ui::MainWindow)
     , m_chatClient(new ChatClient(this))
     , m_database(new Database(this))
+    , m_lastMessageId(0)
+    , m_reconnectAttempts(0)
+    , m_reconnectScheduled(false)
 {
     ui->setupUi(this);
     setWindowTitle("即时通讯客户端");
@@ -25,11 +28,26 @@ MainWindow::MainWindow(QWidget *parent)
 
     // 连接信号
     connect(m_chatClient, &ChatClient::connected, this, [this]() {
-        // 连接成功后，登录窗口会处理登录
+        // 首次连接由登录窗口处理登录；断线重连时用令牌恢复会话
+        if (!m_sessionToken.isEmpty()) {
+            QJsonObject resumeMsg;
+            resumeMsg["type"] = "resume";
+            resumeMsg["token"] = m_sessionToken;
+            resumeMsg["last_message_id"] = m_lastMessageId;
+            m_chatClient->sendJson(resumeMsg);
+        }
     });
     connect(m_chatClient, &ChatClient::disconnected, this, &MainWindow::onDisconnected);
     connect(m_chatClient, &ChatClient::jsonReceived, this, &MainWindow::onJsonReceived);
     connect(m_chatClient, &ChatClient::error, this, [this](const QString &error) {
+        // 已登录后的连接错误交给断线重连处理；重连失败时继续重试，次数用完再提示
+        if (!m_sessionToken.isEmpty()) {
+            if (m_reconnectAttempts > 0 && !m_chatClient->isConnected() && !scheduleReconnect()) {
+                QMessageBox::warning(this, "断开连接", error);
+                close();
+            }
+            return;
+        }
         QMessageBox::critical(this, "错误", error);
     });
 
@@ -50,6 +68,8 @@ MainWindow::MainWindow(QWidget *parent)
             loginMsg["type"] = "login";
             loginMsg["username"] = loginWindow->getUsername();
             loginMsg["password"] = loginWindow->getPassword();
+            // 登录结果和联系人、群组、离线消息合并在一个bootstrap帧里返回
+            loginMsg["bootstrap"] = true;
             m_chatClient->sendJson(loginMsg);
         } else {
             m_chatClient->connectToServer(loginWindow->getServerAddress(), loginWindow->getServerPort());
@@ -79,6 +99,8 @@ MainWindow::MainWindow(QWidget *parent)
             loginMsg["type"] = "login";
             loginMsg["username"] = loginWindow->getUsername();
             loginMsg["password"] = loginWindow->getPassword();
+            // 登录结果和联系人、群组、离线消息合并在一个bootstrap帧里返回
+            loginMsg["bootstrap"] = true;
             m_chatClient->sendJson(loginMsg);
         }
     });
@@ -209,18 +231,81 @@ void MainWindow::onRegisterFailed(const QString &message)
 
 void MainWindow::onDisconnected()
 {
+    if (scheduleReconnect())
+        return;
+
+    m_chatClient->failPendingMessages("与服务器断开连接");
     QMessageBox::warning(this, "断开连接", "与服务器断开连接");
     close();
 }
 
+bool MainWindow::scheduleReconnect()
+{
+    if (m_reconnectScheduled)
+        return true;
+    if (m_sessionToken.isEmpty() || m_reconnectAttempts >= MaxReconnectAttempts)
+        return false;
+
+    ++m_reconnectAttempts;
+    m_reconnectScheduled = true;
+    ui->statusLabel->setText(QString("连接中断，正在重连(%1/%2)...").arg(m_reconnectAttempts).arg(MaxReconnectAttempts));
+    ui->statusLabel->setStyleSheet("color: orange;");
+    QTimer::singleShot(ReconnectDelayMs * m_reconnectAttempts, this, [this]() {
+        m_reconnectScheduled = false;
+        m_chatClient->reconnectToServer();
+    });
+    return true;
+}
+
+void MainWindow::noteMessageId(const QJsonObject &message)
+{
+    m_lastMessageId = qMax(m_lastMessageId, message["id"].toVariant().toLongLong());
+}
+
+void MainWindow::acknowledgePage(const QJsonObject &page)
+{
+    // 确认收到这一页，服务器随后标记已读并发送下一页
+    if (page.contains("cursor")) {
+        QJsonObject ack;
+        ack["type"] = "offline_ack";
+        ack["cursor"] = page["cursor"];
+        m_chatClient->sendJson(ack);
+    }
+}
+
 void MainWindow::onJsonReceived(const QJsonObject &docObj)
 {
     QString type = docObj["type"].toString();
 
     if (type == "login_success") {
         m_username = docObj["username"].toString();
+        m_sessionToken = docObj["token"].toString();
+        onLoginSuccess();
+    }
+    else if (type == "bootstrap") {
+        m_username = docObj["username"].toString();
+        m_sessionToken = docObj["token"].toString();
+        onContactsListReceived(docObj["contacts"].toArray());
+        onGroupsListReceived(docObj["groups"].toArray());
+        if (docObj.contains("offline")) {
+            QJsonObject offline = docObj["offline"].toObject();
+            m_lastMessageId = qMax(m_lastMessageId, offline["cursor"].toVariant().toLongLong());
+            acknowledgePage(offline);
+        }
         onLoginSuccess();
     }
+    else if (type == "resume_success") {
+        m_sessionToken = docObj["token"].toString();
+        m_reconnectAttempts = 0;
+        ui->statusLabel->setText(QString("已登录: %1").arg(m_username));
+        ui->statusLabel->setStyleSheet("color: green;");
+    }
+    else if (type == "resume_failed") {
+        m_sessionToken.clear();
+        m_chatClient->failPendingMessages("会话已过期");
+        QMessageBox::warning(this, "断开连接", docObj["message"].toString());
+        close();
+    }
     else if (type == "login_failed") {
         onLoginFailed(docObj["message"].toString());
     }
@@ -237,12 +322,14 @@ void MainWindow::onJsonReceived(const QJsonObject &docObj)
         onGroupsListReceived(docObj["groups"].toArray());
     }
     else if (type == "private_message") {
+        noteMessageId(docObj);
         QString sender = docObj["sender"].toString();
         QString content = docObj["content"].toString();
         QString timestamp = docObj["timestamp"].toString();
         onPrivateMessageReceived(sender, content, timestamp);
     }
     else if (type == "group_message") {
+        noteMessageId(docObj);
         QString sender = docObj["sender"].toString();
         QString groupName = docObj["group_name"].toString();
         QString content = docObj["content"].toString();
@@ -255,10 +342,26 @@ void MainWindow::onJsonReceived(const QJsonObject &docObj)
     else if (type == "user_offline") {
         onUserOffline(docObj["username"].toString());
     }
+    else if (type == "presence_batch") {
+        // 服务器合并后的上下线变化
+        const QJsonArray changes = docObj["changes"].toArray();
+        for (const QJsonValue &value : changes) {
+            QJsonObject change = value.toObject();
+            updateContactStatus(change["username"].toString(), change["online"].toBool());
+        }
+    }
     else if (type == "offline_messages") {
         // 离线消息已经在loadHistory中加载了，不需要重复显示
         // 注释掉以避免重复显示
         // onOfflineMessagesReceived(docObj["messages"].toArray());
+        m_lastMessageId = qMax(m_lastMessageId, docObj["cursor"].toVariant().toLongLong());
+        acknowledgePage(docObj);
+    }
+    else if (type == "message_delta") {
+        // 断线期间错过的消息，聊天窗口已经打开，需要补显示
+        onOfflineMessagesReceived(docObj["messages"].toArray());
+        m_lastMessageId = qMax(m_lastMessageId, docObj["cursor"].toVariant().toLongLong());
+        acknowledgePage(docObj);
     }
     else if (type == "add_contact_success") {
         QMessageBox::information(this, "成功", "添加联系人成功");
@@ -522,6 +625,8 @@ void MainWindow::on_groupsListWidget_itemDoubleClicked(QListWidgetItem *item)
 
 void MainWindow::on_logoutButton_clicked()
 {
+    // 主动退出，不再重连
+    m_sessionToken.clear();
     m_chatClient->disconnectFromServer();
     close();
 }
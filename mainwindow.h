@@ -59,12 +59,23 @@ private:
     QMap<QString, ChatWindow*> m_chatWindows;  // target -> window
     ChatWindow *m_currentChatWindow;  // 当前显示的聊天窗口
     QString m_currentChatTarget;  // 当前聊天目标
+    QString m_sessionToken;       // 登录成功时服务器签发，断线后用来恢复会话
+    qint64 m_lastMessageId;       // 收到过的最大消息id，恢复会话时只补发之后的消息
+    int m_reconnectAttempts;
+    bool m_reconnectScheduled;
 
     void setupUI();
     void openChatWindow(const QString &target, const QString &type);
     void showContactsPage();
     void showChatPage();
     void updateContactStatus(const QString &username, bool online);
+    void noteMessageId(const QJsonObject &message);
+    void acknowledgePage(const QJsonObject &page);
+    // 有会话令牌且未超过重试次数时安排一次重连，返回是否已安排
+    bool scheduleReconnect();
+
+    static constexpr int MaxReconnectAttempts = 5;
+    static constexpr int ReconnectDelayMs = 1000;
 };
 
 #endif // MAINWINDOW_H
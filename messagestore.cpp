@@ -0,0 +1,413 @@
+#include "messagestore.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDateTime>
+#include <QSharedPointer>
+#include <QDebug>
+#include "database.h"
+#include "relayframe.h"
+#include "sqlitetuning.h"
+#include "sqlstatementcache.h"
+
+static const char *WriterConnectionName = "MessageStoreWriter";
+
+MessageStore::MessageStore(const QString &dbPath, QObject *parent)
+    : QObject(parent)
+    , m_dbPath(dbPath)
+    , m_thread(nullptr)
+    , m_checkpointer(nullptr)
+    , m_lastId(0)
+    , m_committed(0)
+    , m_committedId(0)
+    , m_inFlight(0)
+    , m_running(false)
+    , m_ready(false)
+    , m_stopping(false)
+    , m_flushRequested(false)
+    , m_flushIntervalMs(20)
+    , m_batchSize(256)
+    , m_durability(Normal)
+    , m_durabilityChanged(false)
+{
+    MetricsRegistry *metrics = MetricsRegistry::global();
+    m_persistLatency = metrics->histogram("chat_message_persist_seconds",
+                                          "Time from enqueue to committed in the messages table",
+                                          MetricHistogram::latencyBounds(), 1e-9);
+    m_commitTime = metrics->histogram("chat_message_commit_seconds",
+                                      "Duration of one batch transaction in the message writer",
+                                      MetricHistogram::latencyBounds(), 1e-9);
+    m_batchSizes = metrics->histogram("chat_message_commit_batch_size",
+                                      "Messages per batch transaction in the message writer",
+                                      MetricHistogram::sizeBounds());
+}
+
+MessageStore::~MessageStore()
+{
+    stop();
+}
+
+void MessageStore::setFlushInterval(int msec)
+{
+    QMutexLocker locker(&m_mutex);
+    m_flushIntervalMs = qMax(1, msec);
+}
+
+void MessageStore::setBatchSize(int size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_batchSize = qMax(1, size);
+}
+
+void MessageStore::setDurability(Durability mode)
+{
+    QMutexLocker locker(&m_mutex);
+    m_durability = mode;
+    m_durabilityChanged = true;
+    m_wakeWriter.wakeOne();
+}
+
+bool MessageStore::start()
+{
+    if (m_thread)
+        return m_running;
+
+    m_thread = QThread::create([this]() { writerLoop(); });
+    m_thread->setObjectName("MessageStoreWriter");
+    m_thread->start();
+
+    // 等待写线程打开数据库并读出当前最大id
+    QMutexLocker locker(&m_mutex);
+    while (!m_ready) {
+        m_stateChanged.wait(&m_mutex);
+    }
+
+    // 各连接关闭了自动检查点，由后台线程负责把WAL写回主库
+    SqliteTuning::Options tuning = SqliteTuning::options();
+    if (m_running && tuning.wal && tuning.backgroundCheckpoint) {
+        m_checkpointer = new WalCheckpointer(m_dbPath);
+        m_checkpointer->start();
+    }
+    return m_running;
+}
+
+void MessageStore::stop()
+{
+    if (!m_thread)
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wakeWriter.wakeOne();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running = false;
+        m_stateChanged.wakeAll();
+    }
+
+    // 写线程退出后再停，最后一次检查点能带上最后一批消息
+    delete m_checkpointer;
+    m_checkpointer = nullptr;
+}
+
+qint64 MessageStore::enqueue(const QString &sender, const QString &receiver, const QString &content,
+                             const QString &messageType, const QString &groupName)
+{
+    PendingMessage message;
+    message.content = content;
+    return append(message, sender, receiver, messageType, groupName);
+}
+
+qint64 MessageStore::enqueueRaw(const QString &sender, const QString &receiver, const QByteArray &rawContent,
+                                const QString &messageType, const QString &groupName)
+{
+    PendingMessage message;
+    message.rawContent = rawContent;
+    return append(message, sender, receiver, messageType, groupName);
+}
+
+qint64 MessageStore::append(PendingMessage &message, const QString &sender, const QString &receiver,
+                            const QString &messageType, const QString &groupName)
+{
+    message.sender = sender;
+    message.receiver = receiver;
+    message.messageType = messageType;
+    message.groupName = groupName;
+    message.conversationId = Database::conversationId(messageType, sender, receiver, groupName);
+    // 记录的是入队时间而不是提交时间；created_at保持CURRENT_TIMESTAMP的格式给旧的查询使用
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    message.createdAt = now.toString("yyyy-MM-dd HH:mm:ss");
+    message.createdMs = now.toMSecsSinceEpoch();
+    message.enqueuedNs = MetricsRegistry::nowNs();
+    message.traceId = Tracer::currentTrace();
+
+    QMutexLocker locker(&m_mutex);
+    // 没有写线程时入队的消息永远不会落盘，队列还会无限增长
+    if (!m_running)
+        return 0;
+    message.id = ++m_lastId;
+    m_queue.append(message);
+    if (m_queue.size() >= m_batchSize) {
+        m_wakeWriter.wakeOne();
+    }
+    return message.id;
+}
+
+void MessageStore::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_running)
+        return;
+
+    // 只等调用时已入队的消息：持续有新消息入队时队列可能一直排不空
+    const qint64 target = m_lastId;
+    if (m_committedId >= target)
+        return;
+
+    m_flushRequested = true;
+    m_wakeWriter.wakeOne();
+    while (m_running && m_committedId < target) {
+        m_stateChanged.wait(&m_mutex);
+    }
+}
+
+bool MessageStore::post(const WriteJob &job)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_running)
+        return false;
+
+    m_jobs.append(job);
+    m_wakeWriter.wakeOne();
+    return true;
+}
+
+bool MessageStore::execute(const WriteJob &job)
+{
+    // 结果在m_mutex下写入和读取；job可能在等待方返回后才被丢弃，所以共享所有权
+    struct Result {
+        bool done = false;
+        bool ok = false;
+    };
+    QSharedPointer<Result> result(new Result);
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_running)
+        return false;
+
+    m_jobs.append([this, job, result](QSqlDatabase &db) {
+        bool ok = job(db);
+        QMutexLocker locker(&m_mutex);
+        result->ok = ok;
+        result->done = true;
+        m_stateChanged.wakeAll();
+        return ok;
+    });
+    m_wakeWriter.wakeOne();
+    while (m_running && !result->done) {
+        m_stateChanged.wait(&m_mutex);
+    }
+    return result->ok;
+}
+
+bool MessageStore::isRunning() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running;
+}
+
+int MessageStore::pendingCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_queue.size() + m_inFlight;
+}
+
+qint64 MessageStore::committedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_committed;
+}
+
+void MessageStore::writerLoop()
+{
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", WriterConnectionName);
+        db.setDatabaseName(m_dbPath);
+        bool opened = db.open();
+
+        qint64 lastId = 0;
+        if (opened) {
+            SqliteTuning::applyConnectionPragmas(db);
+            QSqlQuery query(db);
+            if (query.exec("SELECT MAX(id) FROM messages") && query.next()) {
+                lastId = query.value(0).toLongLong();
+            }
+        } else {
+            qCritical() << "消息写线程无法打开数据库:" << db.lastError().text();
+        }
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_lastId = lastId;
+            m_committedId = lastId;
+            m_durabilityChanged = true;
+            m_running = opened;
+            m_ready = true;
+            m_stateChanged.wakeAll();
+        }
+
+        // 结构升级后旧消息的会话标识在这里分批回填，不阻塞服务器启动
+        bool backfilling = opened && Database::backfillPending();
+
+        while (opened) {
+            QVector<PendingMessage> batch;
+            QVector<WriteJob> jobs;
+            {
+                QMutexLocker locker(&m_mutex);
+                // 攒够一批、有其他写操作、被要求刷新或退出时立即写，否则最多等一个刷新间隔；回填期间不等待
+                if (!m_stopping && !m_flushRequested && m_queue.size() < m_batchSize && m_jobs.isEmpty()
+                        && !backfilling) {
+                    m_wakeWriter.wait(&m_mutex, static_cast<unsigned long>(m_flushIntervalMs));
+                }
+                if (m_durabilityChanged) {
+                    applyDurability(db, m_durability);
+                    m_durabilityChanged = false;
+                }
+                jobs.swap(m_jobs);
+                if (m_queue.isEmpty()) {
+                    m_flushRequested = false;
+                    m_stateChanged.wakeAll();
+                    if (m_stopping && jobs.isEmpty())
+                        break;
+                } else {
+                    int count = qMin(m_queue.size(), m_batchSize);
+                    batch = m_queue.mid(0, count);
+                    m_queue.remove(0, count);
+                    m_inFlight = count;
+                }
+            }
+
+            // 每个写操作自己决定是否开事务，失败只影响它自己
+            for (const WriteJob &job : qAsConst(jobs)) {
+                job(db);
+            }
+
+            // 队列空闲时才回填，新消息和其他写操作总是先写
+            if (batch.isEmpty()) {
+                if (backfilling && jobs.isEmpty()) {
+                    bool finished = false;
+                    if (!Database::backfillConversationIds(db, &finished) || finished) {
+                        backfilling = false;
+                    }
+                }
+                continue;
+            }
+
+            qint64 commitStart = MetricsRegistry::nowNs();
+            if (!commitBatch(db, batch)) {
+                qWarning() << "批量写入消息失败，改为逐条写入:" << db.lastError().text();
+                insertOneByOne(db, batch);
+            }
+
+            qint64 committedNs = MetricsRegistry::nowNs();
+            m_commitTime->observe(committedNs - commitStart);
+            m_batchSizes->observe(batch.size());
+            for (const PendingMessage &message : qAsConst(batch)) {
+                m_persistLatency->observe(committedNs - message.enqueuedNs);
+                Tracer::record("persist", message.traceId, message.enqueuedNs, committedNs);
+            }
+
+            QMutexLocker locker(&m_mutex);
+            m_inFlight = 0;
+            m_committed += batch.size();
+            // 队列按id递增，批次最后一条的id就是已提交的最大id
+            m_committedId = batch.last().id;
+            m_stateChanged.wakeAll();
+        }
+
+        SqlStatementCache::release(WriterConnectionName);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(WriterConnectionName);
+}
+
+void MessageStore::applyDurability(QSqlDatabase &db, Durability mode)
+{
+    QSqlQuery query(db);
+    switch (mode) {
+    case Fast:
+        query.exec("PRAGMA synchronous = OFF");
+        break;
+    case Normal:
+        query.exec("PRAGMA synchronous = NORMAL");
+        break;
+    case Full:
+        query.exec("PRAGMA synchronous = FULL");
+        break;
+    }
+}
+
+static const char *InsertMessageSql =
+        "INSERT INTO messages (id, sender, receiver, content, message_type, group_name, "
+        "conversation_id, created_at, created_ms) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)";
+
+void MessageStore::bindMessage(QSqlQuery &query, const PendingMessage &message)
+{
+    query.addBindValue(message.id);
+    query.addBindValue(message.sender);
+    query.addBindValue(message.receiver);
+    if (message.rawContent.isEmpty()) {
+        query.addBindValue(message.content);
+    } else {
+        QString content;
+        if (!RelayFrame::decodeString(message.rawContent, &content)) {
+            qWarning() << "消息内容解码失败，id:" << message.id;
+        }
+        query.addBindValue(content);
+    }
+    query.addBindValue(message.messageType);
+    query.addBindValue(message.groupName);
+    query.addBindValue(message.conversationId);
+    query.addBindValue(message.createdAt);
+    query.addBindValue(message.createdMs);
+}
+
+bool MessageStore::commitBatch(QSqlDatabase &db, const QVector<PendingMessage> &batch)
+{
+    if (!db.transaction())
+        return false;
+
+    SqlStatementCache::Statement &statement =
+            SqlStatementCache::forConnection(db)->prepare("insert_message", InsertMessageSql);
+
+    for (const PendingMessage &message : batch) {
+        bindMessage(statement.query, message);
+        if (!statement.exec()) {
+            db.rollback();
+            return false;
+        }
+    }
+
+    if (!db.commit()) {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+void MessageStore::insertOneByOne(QSqlDatabase &db, const QVector<PendingMessage> &batch)
+{
+    SqlStatementCache::Statement &statement =
+            SqlStatementCache::forConnection(db)->prepare("insert_message", InsertMessageSql);
+
+    for (const PendingMessage &message : batch) {
+        bindMessage(statement.query, message);
+        if (!statement.exec()) {
+            qWarning() << "消息写入失败, id:" << message.id << statement.query.lastError().text();
+        }
+    }
+}
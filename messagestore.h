@@ -0,0 +1,118 @@
+#ifndef MESSAGESTORE_H
+#define MESSAGESTORE_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <functional>
+#include "metrics.h"
+#include "tracer.h"
+
+class WalCheckpointer;
+
+// 异步写入的消息存储：消息先进入内存队列并立即分配id，
+// 由独立的写线程按批次在一个事务中提交（group commit），转发不再等待磁盘
+class MessageStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 对应SQLite的synchronous设置
+    enum Durability {
+        Fast,    // synchronous=OFF，掉电可能丢失最近的批次
+        Normal,  // synchronous=NORMAL
+        Full     // synchronous=FULL，每次提交都落盘
+    };
+
+    // 在写线程上用写连接执行的其他写操作，返回是否成功
+    typedef std::function<bool(QSqlDatabase &db)> WriteJob;
+
+    explicit MessageStore(const QString &dbPath, QObject *parent = nullptr);
+    ~MessageStore();
+
+    // 以下配置可随时修改，写线程在下一批次生效
+    void setFlushInterval(int msec);
+    void setBatchSize(int size);
+    void setDurability(Durability mode);
+
+    bool start();
+    void stop();
+    // 写线程已打开数据库并在运行
+    bool isRunning() const;
+
+    // 放入队列并返回消息id，不等待写入；写线程没有运行时不入队，返回0
+    qint64 enqueue(const QString &sender, const QString &receiver, const QString &content,
+                   const QString &messageType = "private", const QString &groupName = "");
+    // content为未解码的JSON字符串字面量，由写线程解码，转发线程不必解析消息内容
+    qint64 enqueueRaw(const QString &sender, const QString &receiver, const QByteArray &rawContent,
+                      const QString &messageType = "private", const QString &groupName = "");
+    // 阻塞直到调用前入队的消息全部提交，之后入队的不等待
+    void flush();
+
+    // 标记已读、注册用户等写操作也交给写线程，整个进程只有一个写连接。
+    // post不等待结果；execute阻塞到执行完并返回结果，不能在写线程上调用。
+    // 写线程没有运行时都返回false，job不会执行
+    bool post(const WriteJob &job);
+    bool execute(const WriteJob &job);
+
+    int pendingCount() const;
+    qint64 committedCount() const;
+
+private:
+    struct PendingMessage {
+        qint64 id;
+        QString sender;
+        QString receiver;
+        QString content;
+        QByteArray rawContent;
+        QString messageType;
+        QString groupName;
+        QString conversationId;
+        QString createdAt;
+        qint64 createdMs;
+        qint64 enqueuedNs;  // 单调时钟，用于统计入队到提交的延迟
+        quint64 traceId;    // 入队时线程上的trace id
+    };
+
+    void writerLoop();
+    void applyDurability(QSqlDatabase &db, Durability mode);
+    qint64 append(PendingMessage &message, const QString &sender, const QString &receiver,
+                  const QString &messageType, const QString &groupName);
+    static void bindMessage(QSqlQuery &query, const PendingMessage &message);
+    bool commitBatch(QSqlDatabase &db, const QVector<PendingMessage> &batch);
+    void insertOneByOne(QSqlDatabase &db, const QVector<PendingMessage> &batch);
+
+    QString m_dbPath;
+    QThread *m_thread;
+    WalCheckpointer *m_checkpointer;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wakeWriter;
+    QWaitCondition m_stateChanged;  // 写线程就绪或队列排空时通知
+    QVector<PendingMessage> m_queue;
+    QVector<WriteJob> m_jobs;
+    qint64 m_lastId;
+    qint64 m_committed;
+    qint64 m_committedId;  // 已提交的最大消息id，flush()以此为水位
+    int m_inFlight;
+    bool m_running;
+    bool m_ready;
+    bool m_stopping;
+    bool m_flushRequested;
+
+    int m_flushIntervalMs;
+    int m_batchSize;
+    Durability m_durability;
+    bool m_durabilityChanged;
+
+    MetricHistogram *m_persistLatency;  // 入队到提交完成
+    MetricHistogram *m_commitTime;      // 一批的事务耗时
+    MetricHistogram *m_batchSizes;
+};
+
+#endif // MESSAGESTORE_H
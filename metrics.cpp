@@ -0,0 +1,232 @@
+#include "metrics.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QtMath>
+
+MetricHistogram::MetricHistogram(const QVector<double> &bounds, double scale)
+    : m_bounds(bounds)
+    , m_scale(scale > 0 ? scale : 1.0)
+    , m_counts(bounds.size() + 1)
+{
+    for (double bound : bounds) {
+        m_rawBounds.append(static_cast<qint64>(qCeil(bound / m_scale)));
+    }
+}
+
+void MetricHistogram::observe(qint64 raw)
+{
+    // 桶数很少，线性查找比二分更快
+    int index = 0;
+    while (index < m_rawBounds.size() && raw > m_rawBounds.at(index)) {
+        ++index;
+    }
+    m_counts[index].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_rawSum.fetchAndAddRelaxed(raw);
+}
+
+MetricHistogram::Snapshot MetricHistogram::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.bounds = m_bounds;
+    for (const QAtomicInteger<quint64> &count : m_counts) {
+        quint64 value = count.loadRelaxed();
+        snapshot.counts.append(value);
+        snapshot.count += value;
+    }
+    snapshot.sum = m_rawSum.loadRelaxed() * m_scale;
+    return snapshot;
+}
+
+double MetricHistogram::Snapshot::quantile(double q) const
+{
+    if (count == 0)
+        return 0.0;
+
+    const double rank = q * count;
+    quint64 seen = 0;
+    for (int i = 0; i < counts.size(); ++i) {
+        if (counts.at(i) == 0)
+            continue;
+        if (seen + counts.at(i) >= rank) {
+            // 落在+Inf桶里时只能返回最大的有限上界
+            if (i >= bounds.size())
+                return bounds.isEmpty() ? 0.0 : bounds.last();
+            double lower = i > 0 ? bounds.at(i - 1) : 0.0;
+            double fraction = (rank - seen) / counts.at(i);
+            return lower + (bounds.at(i) - lower) * fraction;
+        }
+        seen += counts.at(i);
+    }
+    return bounds.isEmpty() ? 0.0 : bounds.last();
+}
+
+QVector<double> MetricHistogram::latencyBounds()
+{
+    return { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5 };
+}
+
+QVector<double> MetricHistogram::sizeBounds()
+{
+    return { 0, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+}
+
+MetricsRegistry::Entry *MetricsRegistry::find(const QString &name, const QString &labels, Type type)
+{
+    for (const QSharedPointer<Entry> &entry : qAsConst(m_entries)) {
+        if (entry->name == name && entry->labels == labels && entry->type == type)
+            return entry.data();
+    }
+    return nullptr;
+}
+
+MetricCounter *MetricsRegistry::counter(const QString &name, const QString &help, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    if (Entry *entry = find(name, labels, Counter))
+        return entry->counter.data();
+
+    QSharedPointer<Entry> entry(new Entry{ name, help, labels, Counter, {}, {}, {} });
+    entry->counter.reset(new MetricCounter);
+    m_entries.append(entry);
+    return entry->counter.data();
+}
+
+MetricGauge *MetricsRegistry::gauge(const QString &name, const QString &help, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    if (Entry *entry = find(name, labels, Gauge))
+        return entry->gauge.data();
+
+    QSharedPointer<Entry> entry(new Entry{ name, help, labels, Gauge, {}, {}, {} });
+    entry->gauge.reset(new MetricGauge);
+    m_entries.append(entry);
+    return entry->gauge.data();
+}
+
+MetricHistogram *MetricsRegistry::histogram(const QString &name, const QString &help,
+                                            const QVector<double> &bounds, double scale,
+                                            const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    if (Entry *entry = find(name, labels, Histogram))
+        return entry->histogram.data();
+
+    QSharedPointer<Entry> entry(new Entry{ name, help, labels, Histogram, {}, {}, {} });
+    entry->histogram.reset(new MetricHistogram(bounds, scale));
+    m_entries.append(entry);
+    return entry->histogram.data();
+}
+
+QVector<MetricsRegistry::Sample> MetricsRegistry::snapshot() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVector<Sample> samples;
+    samples.reserve(m_entries.size());
+    for (const QSharedPointer<Entry> &entry : m_entries) {
+        Sample sample;
+        sample.name = entry->name;
+        sample.labels = entry->labels;
+        sample.type = entry->type;
+        switch (entry->type) {
+        case Counter:
+            sample.value = entry->counter->value();
+            break;
+        case Gauge:
+            sample.value = entry->gauge->value();
+            break;
+        case Histogram:
+            sample.histogram = entry->histogram->snapshot();
+            sample.value = sample.histogram.count;
+            break;
+        }
+        samples.append(sample);
+    }
+    return samples;
+}
+
+static QByteArray formatValue(double value)
+{
+    return QByteArray::number(value, 'g', 12);
+}
+
+static QByteArray seriesName(const QString &name, const QString &labels, const QString &extraLabel = QString())
+{
+    QByteArray series = name.toUtf8();
+    QString all = labels;
+    if (!extraLabel.isEmpty()) {
+        all = all.isEmpty() ? extraLabel : all + ',' + extraLabel;
+    }
+    if (!all.isEmpty()) {
+        series += '{' + all.toUtf8() + '}';
+    }
+    return series;
+}
+
+QByteArray MetricsRegistry::prometheusText() const
+{
+    const QVector<Sample> samples = snapshot();
+
+    QHash<QString, QString> helps;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const QSharedPointer<Entry> &entry : m_entries) {
+            helps.insert(entry->name, entry->help);
+        }
+    }
+
+    // 同名的不同标签必须连续输出，HELP和TYPE只写一次
+    QByteArray text;
+    QSet<QString> written;
+    for (int i = 0; i < samples.size(); ++i) {
+        const QString &name = samples.at(i).name;
+        if (written.contains(name))
+            continue;
+        written.insert(name);
+
+        static const char *typeNames[] = { "counter", "gauge", "histogram" };
+        text += "# HELP " + name.toUtf8() + ' ' + helps.value(name).toUtf8() + '\n';
+        text += "# TYPE " + name.toUtf8() + ' ' + typeNames[samples.at(i).type] + '\n';
+
+        for (int j = i; j < samples.size(); ++j) {
+            const Sample &sample = samples.at(j);
+            if (sample.name != name)
+                continue;
+
+            if (sample.type != Histogram) {
+                text += seriesName(name, sample.labels) + ' ' + formatValue(sample.value) + '\n';
+                continue;
+            }
+
+            const MetricHistogram::Snapshot &histogram = sample.histogram;
+            quint64 cumulative = 0;
+            for (int b = 0; b < histogram.counts.size(); ++b) {
+                cumulative += histogram.counts.at(b);
+                QString le = b < histogram.bounds.size()
+                        ? QString::number(histogram.bounds.at(b), 'g', 12) : QString("+Inf");
+                text += seriesName(name + "_bucket", sample.labels, QString("le=\"%1\"").arg(le))
+                        + ' ' + QByteArray::number(cumulative) + '\n';
+            }
+            text += seriesName(name + "_sum", sample.labels) + ' ' + formatValue(histogram.sum) + '\n';
+            text += seriesName(name + "_count", sample.labels) + ' ' + QByteArray::number(histogram.count) + '\n';
+        }
+    }
+    return text;
+}
+
+MetricsRegistry *MetricsRegistry::global()
+{
+    static MetricsRegistry registry;
+    return &registry;
+}
+
+qint64 MetricsRegistry::nowNs()
+{
+    static QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed();
+}
@@ -0,0 +1,119 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+// 服务器运行指标：计数器、仪表和直方图。
+// 指标对象注册后一直存在，更新只用原子操作，可在任意线程调用；
+// 导出（Prometheus文本格式）和界面面板读取快照，不会阻塞更新
+
+class MetricCounter
+{
+public:
+    void increment(quint64 delta = 1) { m_value.fetchAndAddRelaxed(delta); }
+    quint64 value() const { return m_value.loadRelaxed(); }
+
+private:
+    QAtomicInteger<quint64> m_value{0};
+};
+
+class MetricGauge
+{
+public:
+    void set(qint64 value) { m_value.storeRelaxed(value); }
+    void add(qint64 delta) { m_value.fetchAndAddRelaxed(delta); }
+    qint64 value() const { return m_value.loadRelaxed(); }
+
+private:
+    QAtomicInteger<qint64> m_value{0};
+};
+
+// 固定桶的直方图。observe()记录整数原始值（如纳秒），导出时乘以scale（如1e-9得到秒），
+// 桶上界按导出单位给出
+class MetricHistogram
+{
+public:
+    MetricHistogram(const QVector<double> &bounds, double scale);
+
+    void observe(qint64 raw);
+
+    struct Snapshot {
+        QVector<double> bounds;       // 导出单位
+        QVector<quint64> counts;      // 每个桶（非累计），最后一个是+Inf
+        quint64 count = 0;
+        double sum = 0.0;             // 导出单位
+
+        // 在桶内线性插值估算分位数，没有样本时返回0
+        double quantile(double q) const;
+    };
+    Snapshot snapshot() const;
+
+    // 常用的桶：延迟（秒）和扇出人数
+    static QVector<double> latencyBounds();
+    static QVector<double> sizeBounds();
+
+private:
+    QVector<qint64> m_rawBounds;
+    QVector<double> m_bounds;
+    double m_scale;
+    QVector<QAtomicInteger<quint64>> m_counts;
+    QAtomicInteger<quint64> m_count{0};
+    QAtomicInteger<qint64> m_rawSum{0};
+};
+
+class MetricsRegistry
+{
+public:
+    enum Type {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    // 同一名称和标签重复获取时返回同一个对象；labels为Prometheus格式，如 type="login"
+    MetricCounter *counter(const QString &name, const QString &help, const QString &labels = QString());
+    MetricGauge *gauge(const QString &name, const QString &help, const QString &labels = QString());
+    MetricHistogram *histogram(const QString &name, const QString &help, const QVector<double> &bounds,
+                               double scale = 1.0, const QString &labels = QString());
+
+    // 某一时刻所有指标的值，供界面显示
+    struct Sample {
+        QString name;
+        QString labels;
+        Type type = Counter;
+        double value = 0.0;                // 计数器和仪表
+        MetricHistogram::Snapshot histogram;
+    };
+    QVector<Sample> snapshot() const;
+
+    // Prometheus文本格式（version 0.0.4）
+    QByteArray prometheusText() const;
+
+    // 进程共用的指标表
+    static MetricsRegistry *global();
+    // 单调时钟（纳秒），用于测量耗时
+    static qint64 nowNs();
+
+private:
+    struct Entry {
+        QString name;
+        QString help;
+        QString labels;
+        Type type;
+        QSharedPointer<MetricCounter> counter;
+        QSharedPointer<MetricGauge> gauge;
+        QSharedPointer<MetricHistogram> histogram;
+    };
+
+    Entry *find(const QString &name, const QString &labels, Type type);
+
+    mutable QMutex m_mutex;
+    QVector<QSharedPointer<Entry>> m_entries;  // 按注册顺序，同名指标相邻导出
+};
+
+#endif // METRICS_H
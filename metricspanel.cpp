@@ -0,0 +1,90 @@
+#include "metricspanel.h"
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QVBoxLayout>
+
+MetricsPanel::MetricsPanel(MetricsRegistry *registry, QWidget *parent)
+    : QWidget(parent)
+    , m_registry(registry)
+    , m_table(new QTableWidget(this))
+{
+    m_table->setColumnCount(5);
+    m_table->setHorizontalHeaderLabels({ "指标", "值", "每秒", "p50", "p99" });
+    m_table->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    m_table->verticalHeader()->setVisible(false);
+    m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_table->setSelectionMode(QAbstractItemView::NoSelection);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addWidget(m_table);
+
+    connect(&m_timer, &QTimer::timeout, this, &MetricsPanel::refresh);
+    m_timer.start(1000);
+    refresh();
+}
+
+void MetricsPanel::refresh()
+{
+    const QVector<MetricsRegistry::Sample> samples = m_registry->snapshot();
+    const double elapsedSecs = m_sinceLast.isValid() ? m_sinceLast.restart() / 1000.0 : 0.0;
+    if (!m_sinceLast.isValid()) {
+        m_sinceLast.start();
+    }
+
+    m_table->setRowCount(samples.size());
+    for (int row = 0; row < samples.size(); ++row) {
+        const MetricsRegistry::Sample &sample = samples.at(row);
+        QString key = sample.labels.isEmpty() ? sample.name : QString("%1{%2}").arg(sample.name, sample.labels);
+
+        QString rate;
+        QString p50;
+        QString p99;
+        // 直方图的样本数和计数器一样单调递增，也显示每秒速率
+        if (sample.type != MetricsRegistry::Gauge) {
+            auto last = m_lastValues.constFind(key);
+            if (last != m_lastValues.constEnd() && elapsedSecs > 0) {
+                rate = formatNumber((sample.value - last.value()) / elapsedSecs);
+            }
+            m_lastValues.insert(key, sample.value);
+        }
+
+        if (sample.type == MetricsRegistry::Histogram && sample.histogram.count > 0) {
+            // 以_seconds结尾的是耗时，其他是数量
+            bool seconds = sample.name.endsWith("_seconds");
+            double q50 = sample.histogram.quantile(0.5);
+            double q99 = sample.histogram.quantile(0.99);
+            p50 = seconds ? formatSeconds(q50) : formatNumber(q50);
+            p99 = seconds ? formatSeconds(q99) : formatNumber(q99);
+        }
+
+        const QStringList cells = { key, formatNumber(sample.value), rate, p50, p99 };
+        for (int column = 0; column < cells.size(); ++column) {
+            QTableWidgetItem *item = m_table->item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem;
+                if (column > 0) {
+                    item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+                }
+                m_table->setItem(row, column, item);
+            }
+            item->setText(cells.at(column));
+        }
+    }
+}
+
+QString MetricsPanel::formatNumber(double value)
+{
+    if (value == static_cast<qint64>(value))
+        return QString::number(static_cast<qint64>(value));
+    return QString::number(value, 'f', 1);
+}
+
+QString MetricsPanel::formatSeconds(double seconds)
+{
+    if (seconds < 0.001)
+        return QString("%1 µs").arg(seconds * 1e6, 0, 'f', 0);
+    if (seconds < 1.0)
+        return QString("%1 ms").arg(seconds * 1e3, 0, 'f', 2);
+    return QString("%1 s").arg(seconds, 0, 'f', 2);
+}
@@ -0,0 +1,37 @@
+#ifndef METRICSPANEL_H
+#define METRICSPANEL_H
+
+#include <QWidget>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "metrics.h"
+
+class QTableWidget;
+
+// 服务器窗口中的实时指标面板：定时读取指标快照，
+// 计数器显示累计值和每秒增量，直方图显示样本数和p50/p99
+class MetricsPanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsPanel(MetricsRegistry *registry = MetricsRegistry::global(), QWidget *parent = nullptr);
+
+    void setRefreshInterval(int msec) { m_timer.setInterval(qMax(100, msec)); }
+
+private slots:
+    void refresh();
+
+private:
+    static QString formatNumber(double value);
+    static QString formatSeconds(double seconds);
+
+    MetricsRegistry *m_registry;
+    QTableWidget *m_table;
+    QTimer m_timer;
+    QElapsedTimer m_sinceLast;
+    QHash<QString, double> m_lastValues;  // 上次刷新时计数器的值，用于算速率
+};
+
+#endif // METRICSPANEL_H
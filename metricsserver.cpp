@@ -0,0 +1,73 @@
+#include "metricsserver.h"
+#include <QTcpSocket>
+#include "tracer.h"
+
+MetricsServer::MetricsServer(MetricsRegistry *registry, QObject *parent)
+    : QTcpServer(parent)
+    , m_registry(registry)
+{
+    connect(this, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (QTcpSocket *socket = nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { handleReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_requests.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MetricsServer::handleReadyRead(QTcpSocket *socket)
+{
+    QByteArray &request = m_requests[socket];
+    request.append(socket->readAll());
+
+    if (request.size() > MaxRequestSize) {
+        m_requests.remove(socket);
+        socket->abort();
+        return;
+    }
+
+    // 等请求头收完整
+    if (!request.contains("\r\n\r\n") && !request.contains("\n\n"))
+        return;
+
+    QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+    m_requests.remove(socket);
+
+    if (requestLine.size() < 2 || requestLine.at(0) != "GET") {
+        respond(socket, "405 Method Not Allowed", "text/plain", "method not allowed\n");
+        return;
+    }
+
+    QByteArray path = requestLine.at(1);
+    int query = path.indexOf('?');
+    if (query >= 0) {
+        path.truncate(query);
+    }
+
+    if (path == "/metrics" || path == "/") {
+        respond(socket, "200 OK", "text/plain; version=0.0.4; charset=utf-8", m_registry->prometheusText());
+    } else if (path == "/trace") {
+        respond(socket, "200 OK", "application/json", Tracer::chromeTraceJson());
+    } else {
+        respond(socket, "404 Not Found", "text/plain", "not found\n");
+    }
+}
+
+void MetricsServer::respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &contentType,
+                            const QByteArray &body)
+{
+    QByteArray response;
+    response.reserve(body.size() + 128);
+    response += "HTTP/1.1 " + status + "\r\n";
+    response += "Content-Type: " + contentType + "\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
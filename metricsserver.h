@@ -0,0 +1,36 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QTcpServer>
+#include <QHash>
+#include <QByteArray>
+#include "metrics.h"
+
+class QTcpSocket;
+
+// 本机管理端口：响应HTTP GET /metrics，返回Prometheus文本格式的指标；
+// GET /trace 返回Tracer当前缓冲的Chrome trace JSON。
+// 只解析请求行，回复后即关闭连接；默认只监听127.0.0.1
+class MetricsServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(MetricsRegistry *registry = MetricsRegistry::global(), QObject *parent = nullptr);
+
+private slots:
+    void onNewConnection();
+
+private:
+    void handleReadyRead(QTcpSocket *socket);
+    void respond(QTcpSocket *socket, const QByteArray &status, const QByteArray &contentType,
+                 const QByteArray &body);
+
+    // 请求头的上限，超过时直接断开
+    static constexpr int MaxRequestSize = 8192;
+
+    MetricsRegistry *m_registry;
+    QHash<QTcpSocket*, QByteArray> m_requests;
+};
+
+#endif // METRICSSERVER_H
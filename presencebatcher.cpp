@@ -0,0 +1,41 @@
+#include "presencebatcher.h"
+#include <QJsonObject>
+
+PresenceBatcher::PresenceBatcher(int windowMs, QObject *parent)
+    : QObject(parent)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(qMax(0, windowMs));
+    connect(&m_timer, &QTimer::timeout, this, &PresenceBatcher::flush);
+}
+
+void PresenceBatcher::post(quint32 recipientId, const QString &username, bool online)
+{
+    m_pending[recipientId].insert(username, online);
+    // 窗口从第一条变化开始计时，之后的变化并入同一批
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+void PresenceBatcher::removeRecipient(quint32 recipientId)
+{
+    m_pending.remove(recipientId);
+}
+
+void PresenceBatcher::flush()
+{
+    QHash<quint32, QHash<QString, bool>> pending;
+    pending.swap(m_pending);
+
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        QJsonArray changes;
+        for (auto change = it.value().constBegin(); change != it.value().constEnd(); ++change) {
+            QJsonObject item;
+            item["username"] = change.key();
+            item["online"] = change.value();
+            changes.append(item);
+        }
+        emit batchReady(it.key(), changes);
+    }
+}
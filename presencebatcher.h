@@ -0,0 +1,37 @@
+#ifndef PRESENCEBATCHER_H
+#define PRESENCEBATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QTimer>
+#include <QJsonArray>
+
+// 合并一小段时间窗口内的上下线变化：每个接收者在窗口结束时只收到一帧，
+// 同一个用户在窗口内多次变化只保留最后的状态
+class PresenceBatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PresenceBatcher(int windowMs = 200, QObject *parent = nullptr);
+
+    void setWindow(int msec) { m_timer.setInterval(qMax(0, msec)); }
+    int window() const { return m_timer.interval(); }
+
+    void post(quint32 recipientId, const QString &username, bool online);
+    void removeRecipient(quint32 recipientId);
+
+signals:
+    // changes: [{"username": ..., "online": true/false}, ...]
+    void batchReady(quint32 recipientId, const QJsonArray &changes);
+
+private slots:
+    void flush();
+
+private:
+    QHash<quint32, QHash<QString, bool>> m_pending;  // recipient id -> (username -> online)
+    QTimer m_timer;
+};
+
+#endif // PRESENCEBATCHER_H
@@ -0,0 +1,280 @@
+#include "relayframe.h"
+#include <QJsonDocument>
+#include <QJsonArray>
+
+int RelayFrame::skipSpace(const char *data, int pos, int size)
+{
+    while (pos < size && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n')) {
+        ++pos;
+    }
+    return pos;
+}
+
+int RelayFrame::skipString(const char *data, int pos, int size)
+{
+    // pos指向开头的引号
+    for (int i = pos + 1; i < size; ++i) {
+        char c = data[i];
+        if (c == '\\') {
+            ++i;
+        } else if (c == '"') {
+            return i + 1;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+static bool isHexDigit(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool RelayFrame::isValidString(const char *data, int start, int end)
+{
+    // start和end包含两端的引号
+    for (int i = start + 1; i < end - 1; ) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c == '\\') {
+            if (i + 1 >= end - 1)
+                return false;
+            char escaped = data[i + 1];
+            if (escaped == 'u') {
+                if (i + 6 > end - 1)
+                    return false;
+                for (int k = i + 2; k < i + 6; ++k) {
+                    if (!isHexDigit(data[k]))
+                        return false;
+                }
+                i += 6;
+            } else if (escaped == '"' || escaped == '\\' || escaped == '/' || escaped == 'b'
+                       || escaped == 'f' || escaped == 'n' || escaped == 'r' || escaped == 't') {
+                i += 2;
+            } else {
+                return false;
+            }
+            continue;
+        }
+        if (c < 0x80) {
+            if (c < 0x20)
+                return false;
+            ++i;
+            continue;
+        }
+
+        // 多字节UTF-8：拒绝多余的续字节、过长编码、代理区和超出U+10FFFF的码点
+        int length;
+        unsigned char min = 0x80, max = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            length = 2;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            length = 3;
+            if (c == 0xE0)
+                min = 0xA0;
+            else if (c == 0xED)
+                max = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            length = 4;
+            if (c == 0xF0)
+                min = 0x90;
+            else if (c == 0xF4)
+                max = 0x8F;
+        } else {
+            return false;
+        }
+        if (i + length > end - 1)
+            return false;
+        unsigned char second = static_cast<unsigned char>(data[i + 1]);
+        if (second < min || second > max)
+            return false;
+        for (int k = i + 2; k < i + length; ++k) {
+            if ((static_cast<unsigned char>(data[k]) & 0xC0) != 0x80)
+                return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+int RelayFrame::skipValue(const char *data, int pos, int size)
+{
+    if (pos >= size)
+        return -1;
+
+    char c = data[pos];
+    if (c == '"')
+        return skipString(data, pos, size);
+
+    if (c == '{' || c == '[') {
+        int depth = 0;
+        for (int i = pos; i < size; ++i) {
+            char ch = data[i];
+            if (ch == '"') {
+                i = skipString(data, i, size);
+                if (i < 0)
+                    return -1;
+                --i;
+            } else if (ch == '{' || ch == '[') {
+                ++depth;
+            } else if (ch == '}' || ch == ']') {
+                if (--depth == 0)
+                    return i + 1;
+            }
+        }
+        return -1;
+    }
+
+    // 数字、true/false/null
+    int i = pos;
+    while (i < size && data[i] != ',' && data[i] != '}' && data[i] != ']'
+           && data[i] != ' ' && data[i] != '\t' && data[i] != '\r' && data[i] != '\n') {
+        ++i;
+    }
+    return i > pos ? i : -1;
+}
+
+bool RelayFrame::parse(const QByteArray &payload, RelayMessage *message)
+{
+    const char *data = payload.constData();
+    const int size = payload.size();
+
+    int pos = skipSpace(data, 0, size);
+    if (pos >= size || data[pos] != '{')
+        return false;
+    pos = skipSpace(data, pos + 1, size);
+
+    int typeStart = -1, typeEnd = -1;
+    int targetStart = -1, targetEnd = -1;
+    int contentStart = -1, contentEnd = -1;
+    int receiverStart = -1, receiverEnd = -1;
+    int groupStart = -1, groupEnd = -1;
+    int clientIdStart = -1, clientIdEnd = -1;
+
+    while (pos < size && data[pos] != '}') {
+        if (data[pos] != '"')
+            return false;
+        int keyEnd = skipString(data, pos, size);
+        if (keyEnd < 0)
+            return false;
+        QByteArray key = QByteArray::fromRawData(data + pos + 1, keyEnd - pos - 2);
+        // 带转义的键名解码后可能与关心的字段同名，按原始字节比较会漏掉重复，交给完整解码
+        if (key.contains('\\'))
+            return false;
+
+        pos = skipSpace(data, keyEnd, size);
+        if (pos >= size || data[pos] != ':')
+            return false;
+        pos = skipSpace(data, pos + 1, size);
+        int valueEnd = skipValue(data, pos, size);
+        if (valueEnd < 0)
+            return false;
+
+        // 关心的字段出现两次时交给完整解码处理
+        int *start = nullptr;
+        int *end = nullptr;
+        if (key == "type") {
+            start = &typeStart;
+            end = &typeEnd;
+        } else if (key == "receiver") {
+            start = &receiverStart;
+            end = &receiverEnd;
+        } else if (key == "group_name") {
+            start = &groupStart;
+            end = &groupEnd;
+        } else if (key == "content") {
+            start = &contentStart;
+            end = &contentEnd;
+        } else if (key == "client_id") {
+            start = &clientIdStart;
+            end = &clientIdEnd;
+        }
+        if (start) {
+            if (*start >= 0)
+                return false;
+            *start = pos;
+            *end = valueEnd;
+        }
+
+        pos = skipSpace(data, valueEnd, size);
+        if (pos < size && data[pos] == ',') {
+            pos = skipSpace(data, pos + 1, size);
+            if (pos < size && data[pos] == '}')
+                return false;
+        } else if (pos >= size || data[pos] != '}') {
+            return false;
+        }
+    }
+    if (pos >= size || skipSpace(data, pos + 1, size) != size)
+        return false;
+
+    if (typeStart < 0 || contentStart < 0 || data[contentStart] != '"')
+        return false;
+
+    QByteArray type = QByteArray::fromRawData(data + typeStart, typeEnd - typeStart);
+    if (type == "\"private_message\"") {
+        message->kind = RelayMessage::Private;
+        targetStart = receiverStart;
+        targetEnd = receiverEnd;
+    } else if (type == "\"group_message\"") {
+        message->kind = RelayMessage::Group;
+        targetStart = groupStart;
+        targetEnd = groupEnd;
+    } else {
+        return false;
+    }
+
+    if (targetStart < 0 || data[targetStart] != '"')
+        return false;
+    // 不合法的字符串交给完整解码，由它拒绝整帧
+    if (!isValidString(data, targetStart, targetEnd) || !isValidString(data, contentStart, contentEnd))
+        return false;
+    if (!decodeString(QByteArray::fromRawData(data + targetStart, targetEnd - targetStart), &message->target))
+        return false;
+
+    message->clientId = 0;
+    if (clientIdStart >= 0) {
+        bool ok = false;
+        message->clientId = QByteArray::fromRawData(data + clientIdStart, clientIdEnd - clientIdStart).toLongLong(&ok);
+        if (!ok)
+            return false;
+    }
+
+    // 唯一的一次拷贝：payload指向解码器的缓冲区，跨线程传递前必须复制
+    message->content = QByteArray(data + contentStart, contentEnd - contentStart);
+    return true;
+}
+
+QByteArray RelayFrame::build(const QJsonObject &meta, const QByteArray &rawContent)
+{
+    QByteArray head = QJsonDocument(meta).toJson(QJsonDocument::Compact);
+
+    QByteArray payload;
+    payload.reserve(head.size() + rawContent.size() + 12);
+    payload.append(head.constData(), head.size() - 1);  // 去掉结尾的'}'
+    if (!meta.isEmpty()) {
+        payload.append(',');
+    }
+    payload.append("\"content\":");
+    payload.append(rawContent);
+    payload.append('}');
+    return payload;
+}
+
+bool RelayFrame::decodeString(const QByteArray &token, QString *out)
+{
+    if (token.size() < 2 || token.at(0) != '"' || token.at(token.size() - 1) != '"')
+        return false;
+
+    if (token.indexOf('\\') < 0) {
+        *out = QString::fromUtf8(token.constData() + 1, token.size() - 2);
+        return true;
+    }
+
+    // 有转义时借用QJsonDocument解析这一个字符串
+    QJsonDocument doc = QJsonDocument::fromJson('[' + token + ']');
+    if (!doc.isArray() || doc.array().size() != 1 || !doc.array().at(0).isString())
+        return false;
+    *out = doc.array().at(0).toString();
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef RELAYFRAME_H
+#define RELAYFRAME_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QMetaType>
+#include <QString>
+
+// 私聊/群聊消息的转发快速通道：只扫描JSON帧的顶层字段，取出路由信息，
+// content保持客户端发来的原始字节（带引号和转义的JSON字符串），转发时原样拼接，不解码也不重新编码
+struct RelayMessage {
+    enum Kind {
+        Private,
+        Group
+    };
+
+    Kind kind = Private;
+    QString target;      // 私聊为receiver，群聊为group_name
+    QByteArray content;  // content字段的原始JSON字符串
+    qint64 clientId = 0; // 客户端生成的消息编号，没有时为0
+    quint64 traceId = 0; // 被Tracer采样时的trace id
+};
+Q_DECLARE_METATYPE(RelayMessage)
+
+class RelayFrame
+{
+public:
+    // payload是JSON且type为private_message/group_message时返回true；
+    // 其他消息或字段不符合预期时返回false，调用方按普通消息完整解码
+    static bool parse(const QByteArray &payload, RelayMessage *message);
+
+    // 把服务器生成的元数据序列化后，在末尾拼上原样的content字段
+    static QByteArray build(const QJsonObject &meta, const QByteArray &rawContent);
+
+    // 解码一个JSON字符串字面量，没有转义字符时直接按UTF-8转换
+    static bool decodeString(const QByteArray &token, QString *out);
+
+private:
+    // 返回从pos开始的一个JSON值之后的位置，格式错误返回-1
+    static int skipValue(const char *data, int pos, int size);
+    static int skipString(const char *data, int pos, int size);
+    static int skipSpace(const char *data, int pos, int size);
+    // 严格检查[start, end)的字符串字面量：转义合法、内容是合法的UTF-8。
+    // skipString只找结尾的引号，不合法的content原样转发后接收方解不开，写线程也存不进去
+    static bool isValidString(const char *data, int start, int end);
+};
+
+#endif // RELAYFRAME_H
@@ -0,0 +1,367 @@
+#include "serverdaemon.h"
+#include "chatserver.h"
+#include "database.h"
+#include "tracer.h"
+#include "sqlitetuning.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QScopedPointer>
+#include <QSettings>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QDebug>
+#include <cstdio>
+
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+static QAtomicInt s_logThreshold(QtInfoMsg);
+
+#ifdef Q_OS_UNIX
+static int s_signalPipe[2] = { -1, -1 };
+
+// 信号处理函数里只能做异步信号安全的事：把信号编号写进管道，由事件循环处理
+static void signalHandler(int signal)
+{
+    char number = static_cast<char>(signal);
+    ssize_t written = ::write(s_signalPipe[1], &number, 1);
+    Q_UNUSED(written);
+}
+#endif
+
+// QtMsgType的数值顺序不是严重程度顺序（QtInfoMsg是4），转换成可比较的级别
+static int severity(QtMsgType type)
+{
+    switch (type) {
+    case QtDebugMsg:
+        return 0;
+    case QtInfoMsg:
+        return 1;
+    case QtWarningMsg:
+        return 2;
+    case QtCriticalMsg:
+        return 3;
+    case QtFatalMsg:
+        return 4;
+    }
+    return 1;
+}
+
+static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    Q_UNUSED(context);
+    if (severity(type) < severity(static_cast<QtMsgType>(s_logThreshold.loadRelaxed())))
+        return;
+
+    static const char *names[] = { "debug", "info", "warning", "error", "fatal" };
+    QByteArray line = QDateTime::currentDateTime().toString(Qt::ISODateWithMs).toUtf8()
+            + ' ' + names[severity(type)] + ' ' + message.toUtf8() + '\n';
+    fwrite(line.constData(), 1, line.size(), stderr);
+    if (type == QtFatalMsg) {
+        abort();
+    }
+}
+
+bool ServerConfig::load(const QString &path, const QVariantMap &overrides, ServerConfig *config, QString *error)
+{
+    ServerConfig result;
+    QScopedPointer<QSettings> settings;
+    if (!path.isEmpty()) {
+        if (!QFileInfo::exists(path)) {
+            *error = QString("配置文件不存在: %1").arg(path);
+            return false;
+        }
+        settings.reset(new QSettings(path, QSettings::IniFormat));
+        if (settings->status() != QSettings::NoError) {
+            *error = QString("配置文件格式错误: %1").arg(path);
+            return false;
+        }
+    }
+
+    // 命令行优先，其次配置文件，最后是默认值
+    auto value = [&](const QString &key, const QVariant &defaultValue) {
+        if (overrides.contains(key))
+            return overrides.value(key);
+        if (settings)
+            return settings->value(key, defaultValue);
+        return defaultValue;
+    };
+
+    QString address = value("address", QString()).toString();
+    if (!address.isEmpty()) {
+        if (address == "any") {
+            result.address = QHostAddress::Any;
+        } else if (address == "localhost") {
+            result.address = QHostAddress::LocalHost;
+        } else if (!result.address.setAddress(address)) {
+            *error = QString("无效的监听地址: %1").arg(address);
+            return false;
+        }
+    }
+
+    bool ok = true;
+    uint port = value("port", result.port).toUInt(&ok);
+    if (!ok || port > 65535) {
+        *error = QString("无效的端口: %1").arg(value("port", QString()).toString());
+        return false;
+    }
+    result.port = static_cast<quint16>(port);
+
+    uint metricsPort = value("metrics_port", result.metricsPort).toUInt(&ok);
+    if (!ok || metricsPort > 65535) {
+        *error = QString("无效的管理端口: %1").arg(value("metrics_port", QString()).toString());
+        return false;
+    }
+    result.metricsPort = static_cast<quint16>(metricsPort);
+
+    result.dbPath = value("db", result.dbPath).toString();
+    result.ioThreads = value("io_threads", result.ioThreads).toInt();
+    result.loginThreads = value("login_threads", result.loginThreads).toInt();
+    result.loginQueue = value("login_queue", result.loginQueue).toInt();
+    result.readThreads = value("read_threads", result.readThreads).toInt();
+    result.logLevel = value("log_level", result.logLevel).toString().toLower();
+    result.traceSampleRate = value("trace_sample_rate", result.traceSampleRate).toDouble();
+    result.storeFlushMs = value("store_flush_ms", result.storeFlushMs).toInt();
+    result.storeBatchSize = value("store_batch_size", result.storeBatchSize).toInt();
+    result.durability = value("durability", result.durability).toString().toLower();
+    result.outboundDropMark = value("outbound_drop_mark", result.outboundDropMark).toLongLong();
+    result.outboundDisconnectMark = value("outbound_disconnect_mark", result.outboundDisconnectMark).toLongLong();
+    result.tokenSecret = value("token_secret", QString()).toString().toUtf8();
+    result.tokenLifetimeSecs = value("token_lifetime", result.tokenLifetimeSecs).toInt();
+    result.wal = value("wal", result.wal).toBool();
+    result.cacheSizeKb = value("cache_size_kb", result.cacheSizeKb).toLongLong();
+    result.mmapSize = value("mmap_size", result.mmapSize).toLongLong();
+    result.walCheckpointMs = value("wal_checkpoint_ms", result.walCheckpointMs).toInt();
+
+    if (!QStringList({ "debug", "info", "warning", "error" }).contains(result.logLevel)) {
+        *error = QString("无效的日志级别: %1").arg(result.logLevel);
+        return false;
+    }
+    if (!QStringList({ "fast", "normal", "full" }).contains(result.durability)) {
+        *error = QString("无效的持久性设置: %1").arg(result.durability);
+        return false;
+    }
+
+    *config = result;
+    return true;
+}
+
+ServerDaemon::ServerDaemon(const QString &configPath, const QVariantMap &overrides, QObject *parent)
+    : QObject(parent)
+    , m_configPath(configPath)
+    , m_overrides(overrides)
+    , m_database(nullptr)
+    , m_server(nullptr)
+    , m_signalNotifier(nullptr)
+    , m_shuttingDown(false)
+{
+}
+
+ServerDaemon::~ServerDaemon()
+{
+    // ChatServer析构时停止写线程，必须在数据库之前销毁
+    delete m_server;
+    delete m_database;
+}
+
+void ServerDaemon::installMessageHandler()
+{
+    qInstallMessageHandler(messageHandler);
+}
+
+bool ServerDaemon::setLogLevel(const QString &level)
+{
+    QtMsgType type;
+    if (level == "debug") {
+        type = QtDebugMsg;
+    } else if (level == "info") {
+        type = QtInfoMsg;
+    } else if (level == "warning") {
+        type = QtWarningMsg;
+    } else if (level == "error") {
+        type = QtCriticalMsg;
+    } else {
+        return false;
+    }
+    s_logThreshold.storeRelaxed(type);
+    return true;
+}
+
+bool ServerDaemon::start()
+{
+    QString error;
+    if (!ServerConfig::load(m_configPath, m_overrides, &m_config, &error)) {
+        qCritical().noquote() << error;
+        return false;
+    }
+    setLogLevel(m_config.logLevel);
+
+    SqliteTuning::Options tuning = SqliteTuning::options();
+    tuning.wal = m_config.wal;
+    tuning.cacheSizeKb = qMax<qint64>(0, m_config.cacheSizeKb);
+    tuning.mmapSize = qMax<qint64>(0, m_config.mmapSize);
+    // 0表示不用后台检查点，交给SQLite在提交时自动做
+    tuning.backgroundCheckpoint = m_config.walCheckpointMs > 0;
+    tuning.checkpointIntervalMs = m_config.walCheckpointMs;
+    SqliteTuning::setOptions(tuning);
+
+    m_database = new Database;
+    // 旧消息的回填交给消息写线程，大库也不会拖慢启动
+    if (!m_database->initializeDatabase(m_config.dbPath, true)) {
+        qCritical().noquote() << "无法打开数据库:" << m_config.dbPath;
+        return false;
+    }
+
+    m_server = new ChatServer(m_database);
+    if (!m_server->messageStore()->isRunning()) {
+        qCritical().noquote() << "消息写线程无法打开数据库:" << m_config.dbPath;
+        return false;
+    }
+    connect(m_server, &ChatServer::logMessage, this, [](const QString &message) {
+        qInfo().noquote() << message;
+    });
+
+    // 只能在listen之前设置的配置
+    m_server->setIoThreadCount(m_config.ioThreads);
+    applyRuntimeConfig(m_config);
+
+    if (!m_server->listen(m_config.address, m_config.port)) {
+        qCritical().noquote() << "监听失败:" << m_server->errorString();
+        return false;
+    }
+    if (m_config.metricsPort != 0 && !m_server->startMetricsServer(m_config.metricsPort)) {
+        return false;
+    }
+
+    setupSignalHandlers();
+    qInfo().noquote() << QString("ChatServerd 已启动，监听 %1:%2，数据库 %3")
+                         .arg(m_config.address.toString()).arg(m_server->serverPort()).arg(m_config.dbPath);
+    return true;
+}
+
+void ServerDaemon::applyRuntimeConfig(const ServerConfig &config)
+{
+    setLogLevel(config.logLevel);
+    Tracer::setSampleRate(config.traceSampleRate);
+
+    if (config.loginThreads > 0) {
+        m_server->loginService()->setMaxConcurrent(config.loginThreads);
+    }
+    m_server->loginService()->setMaxQueued(config.loginQueue);
+    m_server->readPool()->setThreadCount(config.readThreads);
+
+    MessageStore *store = m_server->messageStore();
+    store->setFlushInterval(config.storeFlushMs);
+    store->setBatchSize(config.storeBatchSize);
+    if (config.durability == "fast") {
+        store->setDurability(MessageStore::Fast);
+    } else if (config.durability == "full") {
+        store->setDurability(MessageStore::Full);
+    } else {
+        store->setDurability(MessageStore::Normal);
+    }
+
+    // 只影响之后建立的连接
+    m_server->setOutboundLimits(config.outboundDropMark, config.outboundDisconnectMark);
+    m_server->setSessionTokenLifetime(config.tokenLifetimeSecs);
+    if (!config.tokenSecret.isEmpty()) {
+        m_server->setSessionTokenSecret(config.tokenSecret);
+    }
+}
+
+void ServerDaemon::reload()
+{
+    ServerConfig config;
+    QString error;
+    if (!ServerConfig::load(m_configPath, m_overrides, &config, &error)) {
+        qWarning().noquote() << "重新加载配置失败，保持原配置:" << error;
+        return;
+    }
+
+    if (config.address != m_config.address || config.port != m_config.port
+            || config.dbPath != m_config.dbPath || config.ioThreads != m_config.ioThreads
+            || config.metricsPort != m_config.metricsPort || config.wal != m_config.wal
+            || config.cacheSizeKb != m_config.cacheSizeKb || config.mmapSize != m_config.mmapSize
+            || config.walCheckpointMs != m_config.walCheckpointMs) {
+        qWarning() << "监听地址、端口、数据库、I/O线程数、管理端口和SQLite参数的修改需要重启才能生效";
+    }
+    // 密钥变化会让已发出的会话令牌全部失效，同样留到重启
+    config.tokenSecret = m_config.tokenSecret;
+
+    applyRuntimeConfig(config);
+    config.address = m_config.address;
+    config.port = m_config.port;
+    config.dbPath = m_config.dbPath;
+    config.ioThreads = m_config.ioThreads;
+    config.metricsPort = m_config.metricsPort;
+    config.wal = m_config.wal;
+    config.cacheSizeKb = m_config.cacheSizeKb;
+    config.mmapSize = m_config.mmapSize;
+    config.walCheckpointMs = m_config.walCheckpointMs;
+    m_config = config;
+    qInfo() << "配置已重新加载";
+}
+
+void ServerDaemon::shutdown()
+{
+    if (m_shuttingDown)
+        return;
+    m_shuttingDown = true;
+
+    qInfo() << "正在关闭服务器";
+    if (m_server) {
+        m_server->stopServer();
+        // 排队中的消息在退出前写入数据库
+        m_server->messageStore()->flush();
+    }
+    QCoreApplication::quit();
+}
+
+bool ServerDaemon::setupSignalHandlers()
+{
+#ifdef Q_OS_UNIX
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalPipe) != 0) {
+        qWarning() << "无法创建信号管道，SIGTERM/SIGHUP将使用默认处理";
+        return false;
+    }
+    ::fcntl(s_signalPipe[1], F_SETFL, ::fcntl(s_signalPipe[1], F_GETFL) | O_NONBLOCK);
+
+    m_signalNotifier = new QSocketNotifier(s_signalPipe[0], QSocketNotifier::Read, this);
+    connect(m_signalNotifier, &QSocketNotifier::activated, this, &ServerDaemon::handleSignal);
+
+    struct sigaction action = {};
+    action.sa_handler = signalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGHUP, &action, nullptr);
+    // 客户端断开后继续写socket不应让进程退出
+    ::signal(SIGPIPE, SIG_IGN);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ServerDaemon::handleSignal()
+{
+#ifdef Q_OS_UNIX
+    char number = 0;
+    if (::read(s_signalPipe[0], &number, 1) != 1)
+        return;
+
+    if (number == SIGHUP) {
+        qInfo() << "收到SIGHUP，重新加载配置";
+        reload();
+    } else {
+        qInfo() << "收到信号" << static_cast<int>(number) << "，准备退出";
+        shutdown();
+    }
+#endif
+}
@@ -0,0 +1,79 @@
+#ifndef SERVERDAEMON_H
+#define SERVERDAEMON_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QVariantMap>
+#include <QString>
+
+class QSocketNotifier;
+class Database;
+class ChatServer;
+
+// 无界面服务器的配置：INI文件中的值，可被命令行参数覆盖
+struct ServerConfig {
+    QHostAddress address = QHostAddress::Any;
+    quint16 port = 8888;
+    QString dbPath = "chat_server.db";
+    int ioThreads = 0;          // 0表示按CPU核数
+    int loginThreads = 0;
+    int loginQueue = 1024;
+    int readThreads = 0;
+    QString logLevel = "info";  // debug / info / warning / error
+    quint16 metricsPort = 0;    // 0表示不开管理端口
+    double traceSampleRate = 0.0;
+    int storeFlushMs = 20;
+    int storeBatchSize = 256;
+    QString durability = "normal";  // fast / normal / full
+    qint64 outboundDropMark = 1024 * 1024;
+    qint64 outboundDisconnectMark = 8 * 1024 * 1024;
+    QByteArray tokenSecret;
+    int tokenLifetimeSecs = 24 * 3600;
+    // SQLite连接参数，在打开数据库之前设置，修改需要重启
+    bool wal = true;
+    qint64 cacheSizeKb = 16 * 1024;
+    qint64 mmapSize = 256 * 1024 * 1024;
+    int walCheckpointMs = 1000;
+
+    // 先读文件（path为空时跳过），再套用overrides中的同名键
+    static bool load(const QString &path, const QVariantMap &overrides, ServerConfig *config, QString *error);
+};
+
+// ChatServerd的主体：按配置创建数据库和ChatServer，处理Unix信号。
+// SIGINT/SIGTERM优雅退出（断开客户端、写完排队的消息），SIGHUP重新读取配置文件
+class ServerDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    ServerDaemon(const QString &configPath, const QVariantMap &overrides, QObject *parent = nullptr);
+    ~ServerDaemon();
+
+    bool start();
+
+    // 按日志级别过滤qDebug/qInfo等输出，带时间戳写到stderr
+    static void installMessageHandler();
+    static bool setLogLevel(const QString &level);
+
+public slots:
+    void shutdown();
+    void reload();
+
+private slots:
+    void handleSignal();
+
+private:
+    bool setupSignalHandlers();
+    // 可以在运行中修改的配置
+    void applyRuntimeConfig(const ServerConfig &config);
+
+    QString m_configPath;
+    QVariantMap m_overrides;
+    ServerConfig m_config;
+    Database *m_database;
+    ChatServer *m_server;
+    QSocketNotifier *m_signalNotifier;
+    bool m_shuttingDown;
+};
+
+#endif // SERVERDAEMON_H
@@ -0,0 +1,56 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QVariantMap>
+#include "serverdaemon.h"
+
+// ChatServerd：不依赖Qt Widgets的服务器，配置来自INI文件和命令行参数。
+// 配置文件的键与长参数同名（下划线代替连字符），例如：
+//   port=8888
+//   db=/var/lib/chat/chat_server.db
+//   io_threads=4
+//   log_level=info
+//   metrics_port=9100
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("ChatServerd");
+    ServerDaemon::installMessageHandler();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless chat server");
+    parser.addHelpOption();
+
+    QCommandLineOption configOption({"c", "config"}, "INI configuration file.", "file");
+    QCommandLineOption addressOption("address", "Listen address (any, localhost or an IP).", "address");
+    QCommandLineOption portOption({"p", "port"}, "Listen port.", "port");
+    QCommandLineOption dbOption("db", "SQLite database path.", "file");
+    QCommandLineOption ioThreadsOption("io-threads", "Socket I/O threads (0 = CPU cores).", "count");
+    QCommandLineOption loginThreadsOption("login-threads", "Concurrent credential checks.", "count");
+    QCommandLineOption readThreadsOption("read-threads", "Read-only database threads.", "count");
+    QCommandLineOption logLevelOption("log-level", "debug, info, warning or error.", "level");
+    QCommandLineOption metricsPortOption("metrics-port", "Local Prometheus/trace admin port (0 = off).", "port");
+    QCommandLineOption traceOption("trace-sample-rate", "Fraction of messages to trace (0 = off).", "rate");
+    QCommandLineOption durabilityOption("durability", "Message store durability: fast, normal or full.", "mode");
+
+    const QList<QCommandLineOption> valueOptions = { addressOption, portOption, dbOption, ioThreadsOption,
+                                                     loginThreadsOption, readThreadsOption, logLevelOption,
+                                                     metricsPortOption, traceOption, durabilityOption };
+    parser.addOption(configOption);
+    parser.addOptions(valueOptions);
+    parser.process(app);
+
+    // 命令行给出的值覆盖配置文件，SIGHUP重新加载时同样生效
+    QVariantMap overrides;
+    for (const QCommandLineOption &option : valueOptions) {
+        QString name = option.names().last();
+        if (parser.isSet(option)) {
+            overrides.insert(name.replace('-', '_'), parser.value(option));
+        }
+    }
+
+    ServerDaemon daemon(parser.value(configOption), overrides);
+    if (!daemon.start())
+        return 1;
+
+    return app.exec();
+}
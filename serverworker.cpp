@@ -1,9 +1,25 @@
 #include "serverworker.h"
 #include <QDebug>
 
+MetricCounter *ServerWorker::s_droppedFrames = MetricsRegistry::global()->counter(
+        "chat_outbound_dropped_frames_total", "Low-priority frames dropped because the client was falling behind");
+MetricCounter *ServerWorker::s_slowConsumerDisconnects = MetricsRegistry::global()->counter(
+        "chat_slow_consumer_disconnects_total", "Connections closed because their outbound backlog was too large");
+MetricGauge *ServerWorker::s_pendingBytes = MetricsRegistry::global()->gauge(
+        "chat_outbound_pending_bytes", "Bytes queued or buffered in sockets but not yet written, all connections");
+
 ServerWorker::ServerWorker(QObject *parent)
     : QObject(parent)
     , m_clientSocket(new QTcpSocket(this))
+    , m_userId(0)
+    , m_encoding(WireCodec::Json)
+    , m_outboxBytes(0)
+    , m_socketPending(0)
+    , m_dropMark(1024 * 1024)
+    , m_disconnectMark(8 * 1024 * 1024)
+    , m_droppedFrames(0)
+    , m_flushScheduled(false)
+    , m_slowConsumer(false)
 {
     connect(m_clientSocket, &QTcpSocket::readyRead, this, &ServerWorker::receiveJson);
     connect(m_clientSocket, &QTcpSocket::disconnected, this, &ServerWorker::disconnectedFromClient);
@@ -13,10 +29,18 @@ ServerWorker::ServerWorker(QObject *parent)
     connect(m_clientSocket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error),
             this, &ServerWorker::error);
 #endif
+    connect(m_clientSocket, &QTcpSocket::bytesWritten, this, [this]() {
+        QMutexLocker locker(&m_outboxMutex);
+        setPending(m_outboxBytes, m_clientSocket->bytesToWrite());
+    });
 }
 
 ServerWorker::~ServerWorker()
 {
+    {
+        QMutexLocker locker(&m_outboxMutex);
+        setPending(0, 0);
+    }
     if (m_clientSocket->state() == QAbstractSocket::ConnectedState) {
         m_clientSocket->disconnectFromHost();
     }
@@ -29,52 +53,154 @@ bool ServerWorker::setSocketDescriptor(qintptr socketDescriptor)
 
 void ServerWorker::disconnectFromClient()
 {
+    // 可能由ChatServer所在线程调用，转到worker自己的线程执行
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, &ServerWorker::disconnectFromClient, Qt::QueuedConnection);
+        return;
+    }
     m_clientSocket->disconnectFromHost();
 }
 
-void ServerWorker::sendJson(const QJsonObject &json)
+void ServerWorker::setOutboundLimits(qint64 dropMark, qint64 disconnectMark)
 {
-    QJsonDocument doc(json);
-    QByteArray data = doc.toJson(QJsonDocument::Compact);
-    QByteArray packet;
-    QDataStream stream(&packet, QIODevice::WriteOnly);
-    stream << static_cast<quint32>(data.size());
-    packet.append(data);
-    m_clientSocket->write(packet);
+    QMutexLocker locker(&m_outboxMutex);
+    m_dropMark = dropMark;
+    m_disconnectMark = qMax(dropMark, disconnectMark);
 }
 
-void ServerWorker::receiveJson()
+qint64 ServerWorker::pendingBytes() const
 {
-    QDataStream stream(m_clientSocket);
-    stream.setVersion(QDataStream::Qt_5_15);
-
-    while (true) {
-        if (static_cast<quint32>(m_buffer.size()) < sizeof(quint32)) {
-            if (m_clientSocket->bytesAvailable() < static_cast<qint64>(sizeof(quint32))) {
-                break;
-            }
-            m_buffer.append(m_clientSocket->read(static_cast<qint64>(sizeof(quint32)) - static_cast<qint64>(m_buffer.size())));
-        }
+    QMutexLocker locker(&m_outboxMutex);
+    return m_outboxBytes + m_socketPending;
+}
+
+quint64 ServerWorker::droppedFrames() const
+{
+    QMutexLocker locker(&m_outboxMutex);
+    return m_droppedFrames;
+}
+
+void ServerWorker::sendJson(const QJsonObject &json, Priority priority)
+{
+    sendFrame(FramedMessage::fromJson(json), priority);
+}
+
+void ServerWorker::sendFrame(const FramedMessage &frame, Priority priority)
+{
+    // 在调用方线程里按本连接的编码取出数据，同一帧的同种编码只编码一次
+    writePacket(frame.packet(m_encoding), priority, frame.traceId());
+}
+
+void ServerWorker::writePacket(const QByteArray &packet, Priority priority, quint64 traceId)
+{
+    QMutexLocker locker(&m_outboxMutex);
+    if (m_slowConsumer)
+        return;
 
-        quint32 messageSize;
-        QDataStream sizeStream(m_buffer);
-        sizeStream >> messageSize;
+    qint64 pending = m_outboxBytes + m_socketPending + packet.size();
 
-        if (static_cast<quint32>(m_buffer.size()) < sizeof(quint32) + messageSize) {
-            qint64 remaining = static_cast<qint64>(messageSize) - (static_cast<qint64>(m_buffer.size()) - static_cast<qint64>(sizeof(quint32)));
-            if (m_clientSocket->bytesAvailable() < remaining) {
-                break;
-            }
-            m_buffer.append(m_clientSocket->read(remaining));
+    // 客户端长期不读数据，继续缓存只会占用服务器内存
+    if (pending > m_disconnectMark) {
+        m_slowConsumer = true;
+        m_outbox.clear();
+        m_tracedPackets.clear();
+        setPending(0, m_socketPending);
+        s_slowConsumerDisconnects->increment();
+        QMetaObject::invokeMethod(this, [this]() {
+            qDebug() << "客户端出站积压过多，断开连接";
+            m_clientSocket->abort();
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (priority == LowPriority && pending > m_dropMark) {
+        ++m_droppedFrames;
+        s_droppedFrames->increment();
+        return;
+    }
+
+    m_outbox.append(packet);
+    setPending(m_outboxBytes + packet.size(), m_socketPending);
+    if (traceId) {
+        m_tracedPackets.append(qMakePair(traceId, MetricsRegistry::nowNs()));
+    }
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, &ServerWorker::flushOutbox, Qt::QueuedConnection);
+    }
+}
+
+void ServerWorker::flushOutbox()
+{
+    QVector<QByteArray> packets;
+    QVector<QPair<quint64, qint64>> traced;
+    qint64 bytes = 0;
+    {
+        QMutexLocker locker(&m_outboxMutex);
+        packets.swap(m_outbox);
+        traced.swap(m_tracedPackets);
+        bytes = m_outboxBytes;
+        m_flushScheduled = false;
+    }
+
+    if (packets.isEmpty())
+        return;
+
+    // 本轮事件循环中积攒的帧合并成一次写入
+    if (packets.size() == 1) {
+        m_clientSocket->write(packets.first());
+    } else {
+        QByteArray buffer;
+        buffer.reserve(static_cast<int>(bytes));
+        for (const QByteArray &packet : packets) {
+            buffer.append(packet);
         }
+        m_clientSocket->write(buffer);
+    }
 
-        QByteArray jsonData = m_buffer.mid(sizeof(quint32), messageSize);
-        m_buffer.remove(0, sizeof(quint32) + messageSize);
+    // 区间从入队开始，包含在出站队列中等待的时间
+    if (!traced.isEmpty()) {
+        qint64 writtenNs = MetricsRegistry::nowNs();
+        for (const QPair<quint64, qint64> &item : qAsConst(traced)) {
+            Tracer::record("socket_write", item.first, item.second, writtenNs);
+        }
+    }
 
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(jsonData, &error);
-        if (error.error == QJsonParseError::NoError && doc.isObject()) {
-            emit jsonReceived(this, doc.object());
+    QMutexLocker locker(&m_outboxMutex);
+    // 写出期间新入队的帧仍留在m_outboxBytes中；慢消费者断开时队列已被清空
+    setPending(qMax(Q_INT64_C(0), m_outboxBytes - bytes), m_clientSocket->bytesToWrite());
+}
+
+void ServerWorker::setPending(qint64 outboxBytes, qint64 socketPending)
+{
+    s_pendingBytes->add(outboxBytes + socketPending - m_outboxBytes - m_socketPending);
+    m_outboxBytes = outboxBytes;
+    m_socketPending = socketPending;
+}
+
+void ServerWorker::receiveJson()
+{
+    m_decoder.readFrom(m_clientSocket);
+
+    QByteArray payload;
+    QJsonObject json;
+    RelayMessage relay;
+    while (m_decoder.nextFrame(&payload)) {
+        quint64 traceId = Tracer::sampleTrace();
+        TraceSpan span("decode", traceId);
+
+        // 聊天消息走转发快速通道，不解析整个JSON；两种信号都排队到同一线程，先后顺序不变
+        if (RelayFrame::parse(payload, &relay)) {
+            relay.traceId = traceId;
+            emit relayReceived(this, relay);
+        } else if (WireCodec::decode(payload, &json)) {
+            emit jsonReceived(this, json, traceId);
         }
     }
+
+    // 长度头超过上限，说明数据已经错位或是恶意客户端，直接断开
+    if (m_decoder.hasError()) {
+        qDebug() << "帧长度超过上限，断开客户端";
+        m_clientSocket->abort();
+    }
 }
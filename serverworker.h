@@ -6,35 +6,96 @@
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QThread>
+#include <QMutex>
+#include <QVector>
+#include <QPair>
+#include <QAtomicInteger>
+#include "framedmessage.h"
+#include "framedecoder.h"
+#include "relayframe.h"
+#include "metrics.h"
+#include "tracer.h"
 
 class ServerWorker : public QObject
 {
     Q_OBJECT
 
 public:
+    // 发送优先级：积压超过低水位时先丢弃Low（如上下线通知）
+    enum Priority {
+        LowPriority,
+        NormalPriority
+    };
+
     explicit ServerWorker(QObject *parent = nullptr);
     ~ServerWorker();
 
     bool setSocketDescriptor(qintptr socketDescriptor);
+    // 可在任意线程调用，会被转发到worker所在的I/O线程
     void disconnectFromClient();
     QString getUsername() const { return m_username; }
     void setUsername(const QString &username) { m_username = username; }
+    // 登录后的数字用户id，未登录时为0；与用户名一样只由ChatServer所在线程读写
+    quint32 userId() const { return m_userId; }
+    void setUserId(quint32 userId) { m_userId = userId; }
+    // 发送使用的编码，只由ChatServer所在线程读写
+    WireCodec::Encoding encoding() const { return m_encoding; }
+    void setEncoding(WireCodec::Encoding encoding) { m_encoding = encoding; }
+
+    // 出站积压上限（队列+socket缓冲）：超过dropMark丢弃低优先级帧，超过disconnectMark断开连接
+    void setOutboundLimits(qint64 dropMark, qint64 disconnectMark);
+    qint64 pendingBytes() const;
+    quint64 droppedFrames() const;
+
+    // 所有连接的累计计数
+    static quint64 totalDroppedFrames() { return s_droppedFrames->value(); }
+    static quint64 totalSlowConsumerDisconnects() { return s_slowConsumerDisconnects->value(); }
+    // 所有连接尚未写出的字节数之和
+    static qint64 totalPendingBytes() { return s_pendingBytes->value(); }
 
 signals:
-    void jsonReceived(ServerWorker *sender, const QJsonObject &docObj);
+    // traceId非0表示这条消息被Tracer采样
+    void jsonReceived(ServerWorker *sender, const QJsonObject &docObj, quint64 traceId);
+    // 私聊/群聊消息只取出路由字段，content保持原始字节
+    void relayReceived(ServerWorker *sender, const RelayMessage &message);
     void disconnectedFromClient();
     void error(QAbstractSocket::SocketError socketError);
 
 public slots:
-    void sendJson(const QJsonObject &json);
+    void sendJson(const QJsonObject &json, Priority priority = NormalPriority);
+    // 发送预先编码好的帧，群发时多个worker共享同一份数据
+    void sendFrame(const FramedMessage &frame, Priority priority = NormalPriority);
 
 private slots:
     void receiveJson();
+    void flushOutbox();
 
 private:
+    // 可在任意线程调用：放入出站队列，并安排在worker线程的下一轮事件循环中统一写出
+    void writePacket(const QByteArray &packet, Priority priority, quint64 traceId = 0);
+    // 在持有m_outboxMutex时更新积压字节数，同时调整全局合计
+    void setPending(qint64 outboxBytes, qint64 socketPending);
+
     QTcpSocket *m_clientSocket;
     QString m_username;
-    QByteArray m_buffer;
+    quint32 m_userId;
+    FrameDecoder m_decoder;
+    WireCodec::Encoding m_encoding;
+
+    mutable QMutex m_outboxMutex;
+    QVector<QByteArray> m_outbox;
+    QVector<QPair<quint64, qint64>> m_tracedPackets;  // 出站队列中被采样的帧：trace id、入队时刻
+    qint64 m_outboxBytes;
+    qint64 m_socketPending;  // socket内部还未写出的字节数
+    qint64 m_dropMark;
+    qint64 m_disconnectMark;
+    quint64 m_droppedFrames;
+    bool m_flushScheduled;
+    bool m_slowConsumer;
+
+    static MetricCounter *s_droppedFrames;
+    static MetricCounter *s_slowConsumerDisconnects;
+    static MetricGauge *s_pendingBytes;
 };
 
 #endif // SERVERWORKER_H
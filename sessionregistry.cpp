@@ -0,0 +1,152 @@
+#include "sessionregistry.h"
+
+static const int InitialCapacity = 64;
+
+SessionRegistry::SessionRegistry()
+    : m_count(0)
+    , m_sessionCount(0)
+{
+    m_slots.resize(InitialCapacity);
+}
+
+void SessionRegistry::intern(const QString &username, quint32 userId)
+{
+    m_ids.insert(username, userId);
+    m_names.insert(userId, username);
+}
+
+quint32 SessionRegistry::hashKey(quint32 key)
+{
+    // 整数混洗，避免连续id落在相邻槽位形成长探测链
+    key ^= key >> 16;
+    key *= 0x7feb352dU;
+    key ^= key >> 15;
+    key *= 0x846ca68bU;
+    key ^= key >> 16;
+    return key;
+}
+
+int SessionRegistry::findSlot(quint32 key) const
+{
+    if (key == 0)
+        return -1;
+
+    const int mask = m_slots.size() - 1;
+    int index = static_cast<int>(hashKey(key)) & mask;
+    while (m_slots[index].key != 0) {
+        if (m_slots[index].key == key)
+            return index;
+        index = (index + 1) & mask;
+    }
+    return -1;
+}
+
+int SessionRegistry::add(quint32 userId, ServerWorker *worker)
+{
+    if (userId == 0)
+        return 0;
+
+    // 装载因子超过3/4时扩容
+    if ((m_count + 1) * 4 > m_slots.size() * 3) {
+        rehash(m_slots.size() * 2);
+    }
+
+    const int mask = m_slots.size() - 1;
+    int index = static_cast<int>(hashKey(userId)) & mask;
+    while (m_slots[index].key != 0 && m_slots[index].key != userId) {
+        index = (index + 1) & mask;
+    }
+
+    Slot &slot = m_slots[index];
+    if (slot.key == 0) {
+        slot.key = userId;
+        ++m_count;
+    }
+    if (!slot.workers.contains(worker)) {
+        slot.workers.append(worker);
+        ++m_sessionCount;
+    }
+    return slot.workers.size();
+}
+
+int SessionRegistry::remove(quint32 userId, ServerWorker *worker)
+{
+    int index = findSlot(userId);
+    if (index < 0)
+        return 0;
+
+    Slot &slot = m_slots[index];
+    if (slot.workers.removeOne(worker)) {
+        --m_sessionCount;
+    }
+    int remaining = slot.workers.size();
+    if (remaining == 0) {
+        eraseSlot(index);
+    }
+    return remaining;
+}
+
+void SessionRegistry::eraseSlot(int index)
+{
+    // 后移补位删除：把后面探测链上的元素前移，不需要墓碑标记
+    const int mask = m_slots.size() - 1;
+    m_slots[index] = Slot();
+    --m_count;
+
+    int hole = index;
+    int next = (index + 1) & mask;
+    while (m_slots[next].key != 0) {
+        int ideal = static_cast<int>(hashKey(m_slots[next].key)) & mask;
+        // ideal不在(hole, next]这段循环区间内时，元素可以移到空位上
+        bool movable = (hole <= next) ? (ideal <= hole || ideal > next)
+                                      : (ideal <= hole && ideal > next);
+        if (movable) {
+            m_slots[hole] = std::move(m_slots[next]);
+            m_slots[next] = Slot();
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+void SessionRegistry::rehash(int capacity)
+{
+    QVector<Slot> old;
+    old.swap(m_slots);
+    m_slots.resize(capacity);
+
+    const int mask = capacity - 1;
+    for (Slot &slot : old) {
+        if (slot.key == 0)
+            continue;
+        int index = static_cast<int>(hashKey(slot.key)) & mask;
+        while (m_slots[index].key != 0) {
+            index = (index + 1) & mask;
+        }
+        m_slots[index] = std::move(slot);
+    }
+}
+
+const QVector<ServerWorker*> *SessionRegistry::sessions(quint32 userId) const
+{
+    int index = findSlot(userId);
+    return index >= 0 ? &m_slots[index].workers : nullptr;
+}
+
+QVector<ServerWorker*> SessionRegistry::allSessions() const
+{
+    QVector<ServerWorker*> result;
+    result.reserve(m_sessionCount);
+    for (const Slot &slot : m_slots) {
+        result += slot.workers;
+    }
+    return result;
+}
+
+void SessionRegistry::clear()
+{
+    m_slots.clear();
+    m_slots.resize(InitialCapacity);
+    m_count = 0;
+    m_sessionCount = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef SESSIONREGISTRY_H
+#define SESSIONREGISTRY_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class ServerWorker;
+
+// 在线会话表：以数字用户id为key的开放寻址哈希（线性探测，删除时后移补位），
+// 一个用户可以同时有多个设备在线。用户名只在登录时转换成id一次，之后的路由都不再比较字符串
+class SessionRegistry
+{
+public:
+    SessionRegistry();
+
+    // 用户名 <-> id 的驻留表
+    void intern(const QString &username, quint32 userId);
+    quint32 userId(const QString &username) const { return m_ids.value(username, 0); }
+    QString username(quint32 userId) const { return m_names.value(userId); }
+
+    // 返回该用户当前的会话数
+    int add(quint32 userId, ServerWorker *worker);
+    // 返回该用户剩余的会话数
+    int remove(quint32 userId, ServerWorker *worker);
+
+    // 不在线时返回nullptr；指针在下一次add/remove之前有效
+    const QVector<ServerWorker*> *sessions(quint32 userId) const;
+    bool isOnline(quint32 userId) const { return findSlot(userId) >= 0; }
+
+    int onlineUserCount() const { return m_count; }
+    int sessionCount() const { return m_sessionCount; }
+    QVector<ServerWorker*> allSessions() const;
+    void clear();
+
+private:
+    struct Slot {
+        quint32 key = 0;  // 0表示空槽，数据库id从1开始
+        QVector<ServerWorker*> workers;
+    };
+
+    static quint32 hashKey(quint32 key);
+    int findSlot(quint32 key) const;
+    void eraseSlot(int index);
+    void rehash(int capacity);
+
+    QVector<Slot> m_slots;  // 容量始终是2的幂
+    int m_count;
+    int m_sessionCount;
+
+    QHash<QString, quint32> m_ids;
+    QHash<quint32, QString> m_names;
+};
+
+#endif // SESSIONREGISTRY_H
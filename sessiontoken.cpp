@@ -0,0 +1,80 @@
+#include "sessiontoken.h"
+#include <QMessageAuthenticationCode>
+#include <QCryptographicHash>
+#include <QRandomGenerator>
+#include <QDateTime>
+#include <QList>
+
+static const QByteArray::Base64Options TokenEncoding =
+        QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals;
+
+SessionTokenSigner::SessionTokenSigner(const QByteArray &secret)
+    : m_lifetimeSecs(24 * 60 * 60)
+{
+    setSecret(secret);
+}
+
+void SessionTokenSigner::setSecret(const QByteArray &secret)
+{
+    if (!secret.isEmpty()) {
+        m_secret = secret;
+        return;
+    }
+
+    m_secret.resize(32);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(m_secret.data()),
+                                          m_secret.size() / static_cast<int>(sizeof(quint32)));
+}
+
+QByteArray SessionTokenSigner::sign(const QByteArray &payload) const
+{
+    return QMessageAuthenticationCode::hash(payload, m_secret, QCryptographicHash::Sha256);
+}
+
+QString SessionTokenSigner::issue(quint32 userId, const QString &username) const
+{
+    qint64 expiresMs = QDateTime::currentMSecsSinceEpoch() + qint64(m_lifetimeSecs) * 1000;
+    QByteArray payload = QByteArray::number(userId) + '\n' + username.toUtf8() + '\n'
+            + QByteArray::number(expiresMs);
+
+    return QString::fromLatin1(payload.toBase64(TokenEncoding) + '.' + sign(payload).toBase64(TokenEncoding));
+}
+
+bool SessionTokenSigner::verify(const QString &token, quint32 *userId, QString *username) const
+{
+    QByteArray raw = token.toLatin1();
+    int dot = raw.indexOf('.');
+    if (dot <= 0)
+        return false;
+
+    QByteArray payload = QByteArray::fromBase64(raw.left(dot), TokenEncoding);
+    QByteArray mac = QByteArray::fromBase64(raw.mid(dot + 1), TokenEncoding);
+    QByteArray expected = sign(payload);
+    if (mac.size() != expected.size())
+        return false;
+
+    // 逐字节累积比较，耗时与第几个字节不同无关
+    char diff = 0;
+    for (int i = 0; i < mac.size(); ++i) {
+        diff |= mac.at(i) ^ expected.at(i);
+    }
+    if (diff != 0)
+        return false;
+
+    QList<QByteArray> fields = payload.split('\n');
+    if (fields.size() != 3)
+        return false;
+
+    bool idOk = false;
+    bool expiresOk = false;
+    quint32 id = fields.at(0).toUInt(&idOk);
+    qint64 expiresMs = fields.at(2).toLongLong(&expiresOk);
+    if (!idOk || !expiresOk || id == 0 || expiresMs < QDateTime::currentMSecsSinceEpoch())
+        return false;
+
+    if (userId)
+        *userId = id;
+    if (username)
+        *username = QString::fromUtf8(fields.at(1));
+    return true;
+}
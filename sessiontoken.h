@@ -0,0 +1,31 @@
+#ifndef SESSIONTOKEN_H
+#define SESSIONTOKEN_H
+
+#include <QByteArray>
+#include <QString>
+
+// 会话令牌：登录成功时签发，断线重连时用resume代替用户名密码。
+// 格式为 base64url(用户id\n用户名\n过期时间ms) + "." + base64url(HMAC-SHA256)，
+// 服务器只需保存签名密钥，不需要记录已签发的令牌
+class SessionTokenSigner
+{
+public:
+    // secret为空时生成随机密钥，服务器重启后旧令牌全部失效
+    explicit SessionTokenSigner(const QByteArray &secret = QByteArray());
+
+    void setSecret(const QByteArray &secret);
+    void setLifetime(int seconds) { m_lifetimeSecs = qMax(1, seconds); }
+    int lifetime() const { return m_lifetimeSecs; }
+
+    QString issue(quint32 userId, const QString &username) const;
+    // 签名正确且未过期时返回true
+    bool verify(const QString &token, quint32 *userId, QString *username) const;
+
+private:
+    QByteArray sign(const QByteArray &payload) const;
+
+    QByteArray m_secret;
+    int m_lifetimeSecs;
+};
+
+#endif // SESSIONTOKEN_H
@@ -0,0 +1,162 @@
+#include "sqlitetuning.h"
+#include "sqlstatementcache.h"
+#include <QFileInfo>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QThread>
+#include <QDebug>
+
+static const char *CheckpointConnectionName = "WalCheckpointer";
+
+static QMutex s_optionsMutex;
+static SqliteTuning::Options s_options;
+
+void SqliteTuning::setOptions(const Options &options)
+{
+    QMutexLocker locker(&s_optionsMutex);
+    s_options = options;
+}
+
+SqliteTuning::Options SqliteTuning::options()
+{
+    QMutexLocker locker(&s_optionsMutex);
+    return s_options;
+}
+
+void SqliteTuning::applyConnectionPragmas(QSqlDatabase &db)
+{
+    Options tuning = options();
+    QSqlQuery query(db);
+    query.exec(QString("PRAGMA busy_timeout = %1").arg(tuning.busyTimeoutMs));
+    // 负数表示以KB为单位，与页大小无关
+    query.exec(QString("PRAGMA cache_size = -%1").arg(tuning.cacheSizeKb));
+    query.exec(QString("PRAGMA mmap_size = %1").arg(tuning.mmapSize));
+    query.exec("PRAGMA temp_store = MEMORY");
+
+    if (tuning.wal) {
+        // 关掉自动检查点后，提交只追加WAL，回写主库的工作交给WalCheckpointer；
+        // 自动检查点由提交的连接执行，每个会写的连接（主连接、登录线程、消息写线程）都要设置
+        query.exec(QString("PRAGMA wal_autocheckpoint = %1")
+                   .arg(tuning.backgroundCheckpoint ? 0 : 1000));
+    }
+}
+
+bool SqliteTuning::enableWal(QSqlDatabase &db)
+{
+    QSqlQuery query(db);
+    if (!query.exec("PRAGMA journal_mode = WAL") || !query.next()) {
+        qWarning() << "切换WAL失败:" << query.lastError().text();
+        return false;
+    }
+    QString mode = query.value(0).toString().toLower();
+    if (mode != "wal") {
+        qWarning() << "数据库未能切换到WAL，当前journal_mode:" << mode;
+        return false;
+    }
+    return true;
+}
+
+WalCheckpointer::WalCheckpointer(const QString &dbPath)
+    : m_dbPath(dbPath)
+    , m_thread(nullptr)
+    , m_stopping(false)
+{
+    MetricsRegistry *metrics = MetricsRegistry::global();
+    m_duration = metrics->histogram("chat_wal_checkpoint_seconds",
+                                    "Duration of background WAL checkpoints",
+                                    MetricHistogram::latencyBounds(), 1e-9);
+    m_walBytes = metrics->gauge("chat_wal_bytes", "Size of the SQLite WAL file after the last checkpoint");
+    m_truncations = metrics->counter("chat_wal_truncations_total",
+                                     "Checkpoints that truncated an oversized WAL file");
+}
+
+WalCheckpointer::~WalCheckpointer()
+{
+    stop();
+}
+
+void WalCheckpointer::start()
+{
+    if (m_thread)
+        return;
+
+    m_stopping = false;
+    m_thread = QThread::create([this]() { run(); });
+    m_thread->setObjectName("WalCheckpointer");
+    m_thread->start();
+}
+
+void WalCheckpointer::stop()
+{
+    if (!m_thread)
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeOne();
+    }
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+void WalCheckpointer::run()
+{
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", CheckpointConnectionName);
+        db.setDatabaseName(m_dbPath);
+        if (db.open()) {
+            QSqlQuery query(db);
+            query.exec(QString("PRAGMA busy_timeout = %1").arg(SqliteTuning::options().busyTimeoutMs));
+        } else {
+            qCritical() << "检查点线程无法打开数据库:" << db.lastError().text();
+        }
+
+        while (db.isOpen()) {
+            {
+                QMutexLocker locker(&m_mutex);
+                if (!m_stopping) {
+                    m_wake.wait(&m_mutex, static_cast<unsigned long>(
+                                    qMax(10, SqliteTuning::options().checkpointIntervalMs)));
+                }
+            }
+            // 退出前再做一次，尽量把WAL写回主库
+            checkpoint(db);
+
+            QMutexLocker locker(&m_mutex);
+            if (m_stopping)
+                break;
+        }
+
+        SqlStatementCache::release(CheckpointConnectionName);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(CheckpointConnectionName);
+}
+
+void WalCheckpointer::checkpoint(QSqlDatabase &db)
+{
+    QFileInfo walFile(m_dbPath + "-wal");
+    qint64 walBytes = walFile.exists() ? walFile.size() : 0;
+    // WAL文件只在TRUNCATE/RESTART时变小，超过阈值后截断，避免一次写入高峰让它一直占着磁盘
+    bool truncate = walBytes > SqliteTuning::options().walTruncateBytes;
+
+    SqlStatementCache::Statement &statement = SqlStatementCache::forConnection(db)->prepare(
+                "wal_checkpoint", truncate ? "PRAGMA wal_checkpoint(TRUNCATE)" : "PRAGMA wal_checkpoint(PASSIVE)");
+    qint64 start = MetricsRegistry::nowNs();
+    if (!statement.exec()) {
+        qWarning() << "WAL检查点失败:" << statement.query.lastError().text();
+        return;
+    }
+    m_duration->observe(MetricsRegistry::nowNs() - start);
+
+    // 结果为 busy, log, checkpointed；busy为1表示有读事务挡住了部分页，下次再做
+    if (truncate && statement.query.next() && statement.query.value(0).toInt() == 0) {
+        m_truncations->increment();
+    }
+    statement.query.finish();
+
+    walFile.refresh();
+    m_walBytes->set(walFile.exists() ? walFile.size() : 0);
+}
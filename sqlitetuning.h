@@ -0,0 +1,65 @@
+#ifndef SQLITETUNING_H
+#define SQLITETUNING_H
+
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QString>
+#include <QWaitCondition>
+#include "metrics.h"
+
+class QThread;
+
+// 所有SQLite连接共用的调优参数。每个连接打开后调用applyConnectionPragmas()，
+// 主连接再调用enableWal()；WAL模式记录在数据库文件里，之后所有连接自动生效
+class SqliteTuning
+{
+public:
+    struct Options {
+        bool wal = true;
+        qint64 cacheSizeKb = 16 * 1024;       // 每个连接的页缓存
+        qint64 mmapSize = 256 * 1024 * 1024;  // 0表示不用内存映射
+        int busyTimeoutMs = 5000;
+        // 由WalCheckpointer在后台线程做检查点，所有连接关闭自动检查点，提交时不再顺带写回主库。
+        // 只有启动了检查点线程的进程（MessageStore所在的服务器）才能打开，否则WAL会无限增长
+        bool backgroundCheckpoint = false;
+        int checkpointIntervalMs = 1000;
+        qint64 walTruncateBytes = 64 * 1024 * 1024;  // WAL文件超过该大小时改用TRUNCATE检查点
+    };
+
+    // 进程级设置，应在打开连接之前修改
+    static void setOptions(const Options &options);
+    static Options options();
+
+    // cache_size、mmap_size、busy_timeout、temp_store和自动检查点策略
+    static void applyConnectionPragmas(QSqlDatabase &db);
+    // 切换到WAL（需要写权限），返回实际的journal_mode是否为wal
+    static bool enableWal(QSqlDatabase &db);
+};
+
+// 后台检查点：在独立线程中用自己的连接定期执行PASSIVE检查点，不阻塞写线程；
+// WAL文件过大时执行TRUNCATE，把文件截回0
+class WalCheckpointer
+{
+public:
+    explicit WalCheckpointer(const QString &dbPath);
+    ~WalCheckpointer();
+
+    void start();
+    void stop();
+
+private:
+    void run();
+    void checkpoint(QSqlDatabase &db);
+
+    QString m_dbPath;
+    QThread *m_thread;
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    bool m_stopping;
+
+    MetricHistogram *m_duration;
+    MetricGauge *m_walBytes;
+    MetricCounter *m_truncations;
+};
+
+#endif // SQLITETUNING_H
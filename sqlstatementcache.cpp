@@ -0,0 +1,89 @@
+#include "sqlstatementcache.h"
+#include <QMutex>
+#include <QSqlError>
+#include <QDebug>
+
+// 连接名 -> 缓存。表本身由互斥量保护，取到的缓存只在连接所属线程中使用
+static QMutex s_cachesMutex;
+static QHash<QString, SqlStatementCache*> s_caches;
+
+bool SqlStatementCache::Statement::exec()
+{
+    if (!m_prepared)
+        return false;
+
+    qint64 start = MetricsRegistry::nowNs();
+    bool ok = query.exec();
+    qint64 elapsed = MetricsRegistry::nowNs() - start;
+
+    ++m_calls;
+    m_totalNs += elapsed;
+    m_maxNs = qMax(m_maxNs, elapsed);
+    m_timing->observe(elapsed);
+    return ok;
+}
+
+SqlStatementCache *SqlStatementCache::forConnection(const QSqlDatabase &db)
+{
+    QMutexLocker locker(&s_cachesMutex);
+    SqlStatementCache *&cache = s_caches[db.connectionName()];
+    if (!cache) {
+        cache = new SqlStatementCache(db);
+    }
+    return cache;
+}
+
+void SqlStatementCache::release(const QString &connectionName)
+{
+    SqlStatementCache *cache = nullptr;
+    {
+        QMutexLocker locker(&s_cachesMutex);
+        cache = s_caches.take(connectionName);
+    }
+    delete cache;
+}
+
+SqlStatementCache::Statement &SqlStatementCache::prepare(const QString &name, const QString &sql)
+{
+    auto it = m_statements.find(sql);
+    if (it != m_statements.end() && it.value()->m_prepared) {
+        // 释放上一次未读完的结果集，绑定值在下一次exec时重新从第一个开始
+        it.value()->query.finish();
+        it.value()->m_lastUse = ++m_useClock;
+        return *it.value();
+    }
+
+    if (it == m_statements.end()) {
+        if (m_statements.size() >= MaxStatements) {
+            evictLeastRecentlyUsed();
+        }
+        QSharedPointer<Statement> statement(new Statement(m_db));
+        statement->query.setForwardOnly(true);
+        statement->m_timing = MetricsRegistry::global()->histogram(
+                    "chat_sql_seconds", "SQL statement execution time, by statement",
+                    MetricHistogram::latencyBounds(), 1e-9, QString("statement=\"%1\"").arg(name));
+        it = m_statements.insert(sql, statement);
+    }
+
+    Statement &statement = *it.value();
+    statement.m_lastUse = ++m_useClock;
+    statement.m_prepared = statement.query.prepare(sql);
+    if (!statement.m_prepared) {
+        qWarning() << "SQL预编译失败:" << name << statement.query.lastError().text();
+    }
+    return statement;
+}
+
+void SqlStatementCache::evictLeastRecentlyUsed()
+{
+    // 只在缓存未命中且已满时调用，线性查找的开销可以忽略
+    auto oldest = m_statements.begin();
+    for (auto it = m_statements.begin(); it != m_statements.end(); ++it) {
+        if (it.value()->m_lastUse < oldest.value()->m_lastUse) {
+            oldest = it;
+        }
+    }
+    if (oldest != m_statements.end()) {
+        m_statements.erase(oldest);
+    }
+}
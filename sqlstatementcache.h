@@ -0,0 +1,67 @@
+#ifndef SQLSTATEMENTCACHE_H
+#define SQLSTATEMENTCACHE_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QHash>
+#include <QString>
+#include <QSharedPointer>
+#include "metrics.h"
+
+// 每个数据库连接一份的预编译语句缓存：同一条SQL只prepare一次，之后重新绑定参数直接执行。
+// 连接只在创建它的线程中使用，缓存也不加锁；exec()的耗时按语句名记入
+// chat_sql_seconds{statement="..."} 直方图。
+// 目前经过缓存的有：Database的消息读写、getUserId、getContactOwners和标记已读，
+// 消息写线程的INSERT，登录服务的密码查询和注册，以及WAL检查点；
+// 联系人、群组和用户信息的服务端查询（getUserInfo、addContact、getUserGroups等）还没有改用
+class SqlStatementCache
+{
+public:
+    class Statement
+    {
+    public:
+        QSqlQuery query;
+
+        // 执行并计时；prepare失败时返回false，错误信息在query.lastError()
+        bool exec();
+
+        quint64 calls() const { return m_calls; }
+        qint64 totalNs() const { return m_totalNs; }
+        qint64 maxNs() const { return m_maxNs; }
+
+    private:
+        friend class SqlStatementCache;
+        explicit Statement(const QSqlDatabase &db) : query(db) {}
+
+        bool m_prepared = false;
+        quint64 m_lastUse = 0;  // 缓存满时淘汰最久未用的语句
+        MetricHistogram *m_timing = nullptr;
+        quint64 m_calls = 0;
+        qint64 m_totalNs = 0;
+        qint64 m_maxNs = 0;
+    };
+
+    // 按连接名取缓存，不存在时创建
+    static SqlStatementCache *forConnection(const QSqlDatabase &db);
+    // 在QSqlDatabase::removeDatabase()之前调用，释放该连接上的所有语句
+    static void release(const QString &connectionName);
+
+    // 取出已prepare的语句，上一次的结果集已释放；name用于统计，可被多条SQL共用。
+    // 返回的引用在下一次prepare()之前有效（缓存满时会淘汰最久未用的一条）
+    Statement &prepare(const QString &name, const QString &sql);
+
+    int size() const { return m_statements.size(); }
+
+    // 拼接IN列表等动态SQL会产生很多不同的语句，超过上限时按LRU淘汰，常用语句不受影响
+    static constexpr int MaxStatements = 128;
+
+private:
+    explicit SqlStatementCache(const QSqlDatabase &db) : m_db(db) {}
+    void evictLeastRecentlyUsed();
+
+    QSqlDatabase m_db;
+    QHash<QString, QSharedPointer<Statement>> m_statements;  // SQL -> 语句
+    quint64 m_useClock = 0;
+};
+
+#endif // SQLSTATEMENTCACHE_H
@@ -0,0 +1,34 @@
+QT += core sql testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_chatbench
+TEMPLATE = app
+
+SRC_DIR = ../..
+INCLUDEPATH += $$SRC_DIR
+
+SOURCES += \
+    tst_chatbench.cpp \
+    $$SRC_DIR/framedmessage.cpp \
+    $$SRC_DIR/tracer.cpp \
+    $$SRC_DIR/metrics.cpp \
+    $$SRC_DIR/relayframe.cpp \
+    $$SRC_DIR/wirecodec.cpp \
+    $$SRC_DIR/framedecoder.cpp \
+    $$SRC_DIR/sqlitetuning.cpp \
+    $$SRC_DIR/sqlstatementcache.cpp \
+    $$SRC_DIR/database.cpp
+
+HEADERS += \
+    $$SRC_DIR/framedmessage.h \
+    $$SRC_DIR/tracer.h \
+    $$SRC_DIR/metrics.h \
+    $$SRC_DIR/relayframe.h \
+    $$SRC_DIR/wirecodec.h \
+    $$SRC_DIR/framedecoder.h \
+    $$SRC_DIR/sqlitetuning.h \
+    $$SRC_DIR/sqlstatementcache.h \
+    $$SRC_DIR/database.h
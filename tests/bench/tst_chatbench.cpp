@@ -0,0 +1,318 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include "database.h"
+#include "framedecoder.h"
+#include "framedmessage.h"
+#include "relayframe.h"
+#include "wirecodec.h"
+
+// 微基准：单独测量服务端热点（封帧、拆帧解码、JSON/CBOR编解码、消息表读写）。
+// 机器可读的结果用QtTest自带的输出格式，例如
+//   tst_chatbench -o result.xml,xml    或    -o result.csv,csv
+// 环境变量 CHATBENCH_ROWS 指定合成消息表的行数（默认100万），
+// CHATBENCH_DB 指定数据库文件，已有足够行数时跨次运行复用
+
+// 防止被测代码的结果被编译器优化掉
+static volatile qint64 g_sink = 0;
+
+static const int SyntheticUsers = 1000;
+static const int SyntheticGroups = 50;
+
+// 典型的私聊消息，与服务器转发给接收方的字段一致
+static QJsonObject samplePrivateMessage(int contentSize)
+{
+    QJsonObject message;
+    message["type"] = "private_message";
+    message["id"] = 123456789;
+    message["sender"] = "alice";
+    message["receiver"] = "bob";
+    message["content"] = QString(contentSize, QLatin1Char('x'));
+    message["timestamp"] = "2024-01-01T12:00:00";
+    message["client_id"] = 42;
+    return message;
+}
+
+// 一页50条历史消息，对应get_history的响应
+static QJsonObject sampleHistoryPage()
+{
+    QJsonArray messages;
+    for (int i = 0; i < 50; ++i) {
+        QJsonObject message;
+        message["id"] = 1000 + i;
+        message["sender"] = i % 2 ? "alice" : "bob";
+        message["receiver"] = i % 2 ? "bob" : "alice";
+        message["content"] = QString("message number %1 with some text").arg(i);
+        message["timestamp"] = "2024-01-01T12:00:00";
+        messages.append(message);
+    }
+
+    QJsonObject page;
+    page["type"] = "history";
+    page["target"] = "bob";
+    page["messages"] = messages;
+    page["has_more"] = true;
+    return page;
+}
+
+// 1000帧首尾相接，模拟ServerWorker::receiveJson一次读到的数据
+static QByteArray sampleStream(WireCodec::Encoding encoding)
+{
+    QByteArray stream;
+    for (int i = 0; i < 1000; ++i) {
+        QJsonObject message = samplePrivateMessage(64);
+        message["client_id"] = i;
+        stream.append(WireCodec::frame(WireCodec::encode(message, encoding)));
+    }
+    return stream;
+}
+
+// 批量生成合成消息：users个用户之间的私聊加groups个群的群聊，单事务写入
+static bool populateMessages(const QString &connectionName, int rows)
+{
+    QSqlDatabase db = QSqlDatabase::database(connectionName);
+    if (!db.transaction())
+        return false;
+
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO messages (sender, receiver, content, message_type, group_name, timestamp, "
+                  "conversation_id, created_ms) VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+
+    const qint64 baseMs = QDateTime(QDate(2024, 1, 1), QTime(0, 0)).toMSecsSinceEpoch();
+    for (int i = 0; i < rows; ++i) {
+        QString sender = QString("user%1").arg(i % SyntheticUsers);
+        QString receiver;
+        QString type;
+        QString groupName;
+        // 五分之一是群消息
+        if (i % 5 == 0) {
+            type = "group";
+            groupName = QString("group%1").arg((i / 5) % SyntheticGroups);
+            receiver = groupName;
+        } else {
+            type = "private";
+            receiver = QString("user%1").arg((i * 7 + 1) % SyntheticUsers);
+        }
+
+        qint64 ms = baseMs + i * 1000LL;
+        query.addBindValue(sender);
+        query.addBindValue(receiver);
+        query.addBindValue(QString("synthetic message %1").arg(i));
+        query.addBindValue(type);
+        query.addBindValue(groupName);
+        query.addBindValue(QDateTime::fromMSecsSinceEpoch(ms).toString(Qt::ISODate));
+        query.addBindValue(Database::conversationId(type, sender, receiver, groupName));
+        query.addBindValue(ms);
+        if (!query.exec()) {
+            db.rollback();
+            return false;
+        }
+    }
+
+    return db.commit();
+}
+
+class ChatBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void sendJson_data();
+    void sendJson();
+    void fanout();
+
+    void receiveJson_data();
+    void receiveJson();
+
+    void jsonRoundtrip_data();
+    void jsonRoundtrip();
+    void jsonParse();
+    void cborRoundtrip();
+
+    // 读在写之前，避免写入的行影响读的结果
+    void getMessages_data();
+    void getMessages();
+    void saveMessage();
+
+private:
+    QTemporaryDir m_tempDir;
+    Database m_database;
+    int m_counter = 0;
+};
+
+void ChatBench::initTestCase()
+{
+    bool ok = false;
+    int rows = qEnvironmentVariableIntValue("CHATBENCH_ROWS", &ok);
+    if (!ok)
+        rows = 1000000;
+
+    QString dbPath = qEnvironmentVariable("CHATBENCH_DB");
+    if (dbPath.isEmpty()) {
+        QVERIFY(m_tempDir.isValid());
+        dbPath = m_tempDir.filePath("bench.db");
+    }
+    QVERIFY2(m_database.initializeDatabase(dbPath), qPrintable(dbPath));
+
+    qint64 existing = 0;
+    {
+        QSqlQuery count(QSqlDatabase::database("ClientConnection"));
+        if (count.exec("SELECT COUNT(*) FROM messages") && count.next())
+            existing = count.value(0).toLongLong();
+    }
+    if (existing < rows) {
+        qInfo("Populating %lld synthetic messages", static_cast<long long>(rows - existing));
+        QVERIFY(populateMessages("ClientConnection", static_cast<int>(rows - existing)));
+    }
+}
+
+void ChatBench::sendJson_data()
+{
+    QTest::addColumn<int>("encoding");
+    QTest::newRow("json") << static_cast<int>(WireCodec::Json);
+    QTest::newRow("cbor") << static_cast<int>(WireCodec::Cbor);
+}
+
+// 与ServerWorker::sendJson相同：每条消息构造FramedMessage并编码出带长度头的数据包
+void ChatBench::sendJson()
+{
+    QFETCH(int, encoding);
+    const QJsonObject message = samplePrivateMessage(64);
+
+    QBENCHMARK {
+        g_sink = g_sink + FramedMessage::fromJson(message).packet(static_cast<WireCodec::Encoding>(encoding)).size();
+    }
+}
+
+// 群发：一次编码，100个接收者共享
+void ChatBench::fanout()
+{
+    const QJsonObject message = samplePrivateMessage(64);
+
+    QBENCHMARK {
+        FramedMessage frame = FramedMessage::fromJson(message);
+        for (int i = 0; i < 100; ++i) {
+            g_sink = g_sink + frame.packet(WireCodec::Json).size();
+        }
+    }
+}
+
+void ChatBench::receiveJson_data()
+{
+    QTest::addColumn<QByteArray>("stream");
+    QTest::addColumn<bool>("relay");
+    QTest::newRow("json") << sampleStream(WireCodec::Json) << false;
+    QTest::newRow("relay") << sampleStream(WireCodec::Json) << true;
+    QTest::newRow("cbor") << sampleStream(WireCodec::Cbor) << false;
+}
+
+// ServerWorker::receiveJson的拆帧循环：FrameDecoder + RelayFrame/WireCodec
+void ChatBench::receiveJson()
+{
+    QFETCH(QByteArray, stream);
+    QFETCH(bool, relay);
+
+    QBENCHMARK {
+        QBuffer buffer;
+        buffer.setData(stream);
+        buffer.open(QIODevice::ReadOnly);
+
+        FrameDecoder decoder;
+        decoder.readFrom(&buffer);
+
+        QByteArray payload;
+        QJsonObject json;
+        RelayMessage message;
+        while (decoder.nextFrame(&payload)) {
+            if (relay && RelayFrame::parse(payload, &message)) {
+                g_sink = g_sink + message.content.size();
+            } else if (WireCodec::decode(payload, &json)) {
+                g_sink = g_sink + json.size();
+            }
+        }
+    }
+}
+
+void ChatBench::jsonRoundtrip_data()
+{
+    QTest::addColumn<QJsonObject>("object");
+    QTest::newRow("message") << samplePrivateMessage(64);
+    QTest::newRow("history_page") << sampleHistoryPage();
+}
+
+void ChatBench::jsonRoundtrip()
+{
+    QFETCH(QJsonObject, object);
+
+    QBENCHMARK {
+        QByteArray data = QJsonDocument(object).toJson(QJsonDocument::Compact);
+        g_sink = g_sink + QJsonDocument::fromJson(data).object().size();
+    }
+}
+
+void ChatBench::jsonParse()
+{
+    const QByteArray pageJson = QJsonDocument(sampleHistoryPage()).toJson(QJsonDocument::Compact);
+
+    QBENCHMARK {
+        g_sink = g_sink + QJsonDocument::fromJson(pageJson).object().size();
+    }
+}
+
+void ChatBench::cborRoundtrip()
+{
+    const QJsonObject page = sampleHistoryPage();
+
+    QBENCHMARK {
+        QJsonObject json;
+        WireCodec::decode(WireCodec::encode(page, WireCodec::Cbor), &json);
+        g_sink = g_sink + json.size();
+    }
+}
+
+void ChatBench::getMessages_data()
+{
+    QTest::addColumn<QString>("messageType");
+    QTest::newRow("private") << QString("private");
+    QTest::newRow("group") << QString("group");
+}
+
+void ChatBench::getMessages()
+{
+    QFETCH(QString, messageType);
+    const bool group = messageType == "group";
+
+    QBENCHMARK {
+        int n = m_counter++;
+        if (group) {
+            g_sink = g_sink + m_database.getMessages(QString("group%1").arg(n % SyntheticGroups),
+                                                     messageType, QString(), 100).size();
+        } else {
+            QString a = QString("user%1").arg(n % SyntheticUsers);
+            QString b = QString("user%1").arg((n * 7 + 1) % SyntheticUsers);
+            g_sink = g_sink + m_database.getMessages(b, messageType, a, 100).size();
+        }
+    }
+}
+
+void ChatBench::saveMessage()
+{
+    QBENCHMARK {
+        int n = m_counter++;
+        QString sender = QString("user%1").arg(n % SyntheticUsers);
+        QString receiver = QString("user%1").arg((n + 1) % SyntheticUsers);
+        g_sink = g_sink + m_database.saveMessage(sender, receiver, "benchmark message");
+    }
+}
+
+QTEST_GUILESS_MAIN(ChatBench)
+
+#include "tst_chatbench.moc"
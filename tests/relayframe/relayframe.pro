@@ -0,0 +1,18 @@
+QT += core testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_relayframe
+TEMPLATE = app
+
+SRC_DIR = ../..
+INCLUDEPATH += $$SRC_DIR
+
+SOURCES += \
+    tst_relayframe.cpp \
+    $$SRC_DIR/relayframe.cpp
+
+HEADERS += \
+    $$SRC_DIR/relayframe.h
@@ -0,0 +1,183 @@
+#include <QtTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "relayframe.h"
+
+// RelayFrame::parse直接扫描来自套接字的字节：凡是拿不准的帧都必须返回false，
+// 交给完整的JSON解码处理；接受的帧里content必须原样转发
+
+class TestRelayFrame : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parsesPrivateMessage();
+    void parsesGroupMessage();
+    void decodesEscapedTarget();
+    void toleratesWhitespace();
+
+    void rejected_data();
+    void rejected();
+
+    void buildKeepsContent_data();
+    void buildKeepsContent();
+};
+
+void TestRelayFrame::parsesPrivateMessage()
+{
+    QByteArray payload = "{\"type\":\"private_message\",\"receiver\":\"bob\",\"content\":\"hi \\\"there\\\"\","
+                         "\"client_id\":42,\"extra\":{\"nested\":[1,\"}\"]}}";
+    RelayMessage message;
+    QVERIFY(RelayFrame::parse(payload, &message));
+    QCOMPARE(message.kind, RelayMessage::Private);
+    QCOMPARE(message.target, QString("bob"));
+    QCOMPARE(message.content, QByteArray("\"hi \\\"there\\\"\""));
+    QCOMPARE(message.clientId, Q_INT64_C(42));
+}
+
+void TestRelayFrame::parsesGroupMessage()
+{
+    // 私聊的receiver字段与群聊无关，不影响目标
+    QByteArray payload = "{\"content\":\"x\",\"group_name\":\"team\",\"type\":\"group_message\",\"receiver\":\"bob\"}";
+    RelayMessage message;
+    message.clientId = 7;
+    QVERIFY(RelayFrame::parse(payload, &message));
+    QCOMPARE(message.kind, RelayMessage::Group);
+    QCOMPARE(message.target, QString("team"));
+    QCOMPARE(message.content, QByteArray("\"x\""));
+    QCOMPARE(message.clientId, Q_INT64_C(0));
+}
+
+void TestRelayFrame::decodesEscapedTarget()
+{
+    QByteArray payload = "{\"type\":\"private_message\",\"receiver\":\"b\\u00f6b\",\"content\":\"\xE4\xBD\xA0\xE5\xA5\xBD\"}";
+    RelayMessage message;
+    QVERIFY(RelayFrame::parse(payload, &message));
+    QCOMPARE(message.target, QString::fromUtf8("b\xC3\xB6" "b"));
+    QCOMPARE(message.content, QByteArray("\"\xE4\xBD\xA0\xE5\xA5\xBD\""));
+}
+
+void TestRelayFrame::toleratesWhitespace()
+{
+    QByteArray payload = " \r\n{ \"type\" : \"private_message\" ,\n\t\"receiver\":\"bob\" , \"content\" : \"x\" }\n ";
+    RelayMessage message;
+    QVERIFY(RelayFrame::parse(payload, &message));
+    QCOMPARE(message.target, QString("bob"));
+    QCOMPARE(message.content, QByteArray("\"x\""));
+}
+
+void TestRelayFrame::rejected_data()
+{
+    QTest::addColumn<QByteArray>("payload");
+
+    const QByteArray head = "\"type\":\"private_message\",\"receiver\":\"bob\"";
+
+    // 关心的字段重复：完整解码与快速通道可能取到不同的值
+    QTest::newRow("duplicate type") << QByteArray("{" + head + ",\"content\":\"x\",\"type\":\"group_message\"}");
+    QTest::newRow("duplicate receiver") << QByteArray("{" + head + ",\"content\":\"x\",\"receiver\":\"eve\"}");
+    QTest::newRow("duplicate content") << QByteArray("{" + head + ",\"content\":\"x\",\"content\":\"y\"}");
+    QTest::newRow("duplicate client_id") << QByteArray("{" + head + ",\"content\":\"x\",\"client_id\":1,\"client_id\":2}");
+
+    // 键名带转义时按原始字节比较不出重复
+    QTest::newRow("escaped duplicate key") << QByteArray("{" + head + ",\"content\":\"x\",\"re\\u0063eiver\":\"eve\"}");
+    QTest::newRow("escaped type key") << QByteArray("{\"\\u0074ype\":\"private_message\",\"receiver\":\"bob\",\"content\":\"x\"}");
+
+    // 不合法的UTF-8
+    QTest::newRow("utf8 lone continuation") << QByteArray("{" + head + ",\"content\":\"\x80\"}");
+    QTest::newRow("utf8 overlong") << QByteArray("{" + head + ",\"content\":\"\xC0\xAF\"}");
+    QTest::newRow("utf8 overlong 3 bytes") << QByteArray("{" + head + ",\"content\":\"\xE0\x80\xAF\"}");
+    QTest::newRow("utf8 surrogate") << QByteArray("{" + head + ",\"content\":\"\xED\xA0\x80\"}");
+    QTest::newRow("utf8 above U+10FFFF") << QByteArray("{" + head + ",\"content\":\"\xF4\x90\x80\x80\"}");
+    QTest::newRow("utf8 truncated") << QByteArray("{" + head + ",\"content\":\"\xE4\xBD" "\"}");
+    QTest::newRow("utf8 in target") << QByteArray("{\"type\":\"private_message\",\"receiver\":\"\xFF\",\"content\":\"x\"}");
+
+    // 不合法的转义和控制字符
+    QTest::newRow("unknown escape") << QByteArray("{" + head + ",\"content\":\"\\x41\"}");
+    QTest::newRow("bad unicode escape") << QByteArray("{" + head + ",\"content\":\"\\u12G4\"}");
+    QTest::newRow("short unicode escape") << QByteArray("{" + head + ",\"content\":\"\\u12\"}");
+    QTest::newRow("raw control character") << QByteArray("{" + head + ",\"content\":\"a\tb\"}");
+    QTest::newRow("bad escape in target") << QByteArray("{\"type\":\"private_message\",\"receiver\":\"\\q\",\"content\":\"x\"}");
+
+    // 对象之后还有内容，或结构不完整
+    QTest::newRow("trailing garbage") << QByteArray("{" + head + ",\"content\":\"x\"} x");
+    QTest::newRow("trailing brace") << QByteArray("{" + head + ",\"content\":\"x\"}}");
+    QTest::newRow("two objects") << QByteArray("{" + head + ",\"content\":\"x\"}{}");
+    QTest::newRow("trailing comma") << QByteArray("{" + head + ",\"content\":\"x\",}");
+    QTest::newRow("unterminated") << QByteArray("{" + head + ",\"content\":\"x\"");
+    QTest::newRow("unterminated string") << QByteArray("{" + head + ",\"content\":\"x}");
+
+    // client_id必须是整数
+    QTest::newRow("client_id fraction") << QByteArray("{" + head + ",\"content\":\"x\",\"client_id\":1.5}");
+    QTest::newRow("client_id exponent") << QByteArray("{" + head + ",\"content\":\"x\",\"client_id\":1e3}");
+    QTest::newRow("client_id string") << QByteArray("{" + head + ",\"content\":\"x\",\"client_id\":\"42\"}");
+    QTest::newRow("client_id bool") << QByteArray("{" + head + ",\"content\":\"x\",\"client_id\":true}");
+    QTest::newRow("client_id null") << QByteArray("{" + head + ",\"content\":\"x\",\"client_id\":null}");
+
+    // 不走快速通道的消息
+    QTest::newRow("other type") << QByteArray("{\"type\":\"login\",\"receiver\":\"bob\",\"content\":\"x\"}");
+    QTest::newRow("missing receiver") << QByteArray("{\"type\":\"private_message\",\"content\":\"x\"}");
+    QTest::newRow("missing group_name") << QByteArray("{\"type\":\"group_message\",\"receiver\":\"bob\",\"content\":\"x\"}");
+    QTest::newRow("content not a string") << QByteArray("{" + head + ",\"content\":{\"text\":\"x\"}}");
+    QTest::newRow("receiver not a string") << QByteArray("{\"type\":\"private_message\",\"receiver\":1,\"content\":\"x\"}");
+    QTest::newRow("not an object") << QByteArray("[\"private_message\"]");
+    QTest::newRow("empty") << QByteArray();
+}
+
+void TestRelayFrame::rejected()
+{
+    QFETCH(QByteArray, payload);
+    RelayMessage message;
+    QVERIFY(!RelayFrame::parse(payload, &message));
+}
+
+void TestRelayFrame::buildKeepsContent_data()
+{
+    QTest::addColumn<QByteArray>("rawContent");
+    QTest::addColumn<QString>("decoded");
+
+    QTest::newRow("plain") << QByteArray("\"hello\"") << QString("hello");
+    QTest::newRow("escapes") << QByteArray("\"a\\\"b\\\\c\\n\\/\"") << QString("a\"b\\c\n/");
+    QTest::newRow("unicode escape") << QByteArray("\"\\u4f60\\u597d\"") << QString::fromUtf8("\xE4\xBD\xA0\xE5\xA5\xBD");
+    QTest::newRow("raw utf8") << QByteArray("\"\xF0\x9F\x98\x80\"") << QString::fromUtf8("\xF0\x9F\x98\x80");
+    QTest::newRow("empty") << QByteArray("\"\"") << QString();
+}
+
+void TestRelayFrame::buildKeepsContent()
+{
+    QFETCH(QByteArray, rawContent);
+    QFETCH(QString, decoded);
+
+    QJsonObject meta;
+    meta["type"] = "private_message";
+    meta["id"] = 123;
+    meta["sender"] = "alice";
+    meta["receiver"] = "bob";
+    meta["timestamp"] = "2024-01-01T12:00:00";
+
+    // 转发的帧里content是原始字节
+    QByteArray payload = RelayFrame::build(meta, rawContent);
+    QVERIFY(payload.endsWith("\"content\":" + rawContent + "}"));
+
+    // 接收方完整解码后得到与发送方相同的内容，元数据也都在
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(payload, &error);
+    QCOMPARE(error.error, QJsonParseError::NoError);
+    QJsonObject object = doc.object();
+    QCOMPARE(object["content"].toString(), decoded);
+    QCOMPARE(object["sender"].toString(), QString("alice"));
+    QCOMPARE(object["id"].toInt(), 123);
+
+    // 服务器生成的帧再次经过快速通道，content不变
+    RelayMessage message;
+    QVERIFY(RelayFrame::parse(payload, &message));
+    QCOMPARE(message.content, rawContent);
+    QCOMPARE(message.target, QString("bob"));
+
+    QString content;
+    QVERIFY(RelayFrame::decodeString(message.content, &content));
+    QCOMPARE(content, decoded);
+}
+
+QTEST_APPLESS_MAIN(TestRelayFrame)
+
+#include "tst_relayframe.moc"
@@ -0,0 +1,220 @@
+#include "tracer.h"
+#include "metrics.h"
+#include <QAtomicInteger>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QtMath>
+#include <atomic>
+
+namespace {
+
+struct TraceEvent {
+    QAtomicInteger<quint32> seq;  // 奇数表示正在写入
+    const char *name = nullptr;
+    quint64 traceId = 0;
+    qint64 startNs = 0;
+    qint64 durationNs = 0;
+};
+
+// 只由所属线程写入，导出时由其他线程按序号校验后读取
+struct ThreadBuffer {
+    int tid = 0;
+    QString threadName;
+    QAtomicInteger<quint64> head{0};
+    TraceEvent events[Tracer::BufferCapacity];
+};
+
+QAtomicInteger<quint32> s_samplePeriod(0);  // 每多少条采样一条，0为关闭
+QAtomicInteger<quint64> s_lastTraceId(0);
+
+QMutex s_registryMutex;                     // 只在线程第一次记录和导出时使用
+QVector<ThreadBuffer*> s_buffers;           // 线程退出后仍保留，导出时还能看到它的事件
+QHash<QString, QByteArray> s_internedNames;
+
+thread_local ThreadBuffer *t_buffer = nullptr;
+thread_local quint64 t_currentTrace = 0;
+thread_local quint32 t_sampleCounter = 0;
+
+ThreadBuffer *threadBuffer()
+{
+    if (t_buffer)
+        return t_buffer;
+
+    ThreadBuffer *buffer = new ThreadBuffer;
+    QThread *thread = QThread::currentThread();
+    QMutexLocker locker(&s_registryMutex);
+    buffer->tid = s_buffers.size() + 1;
+    buffer->threadName = thread && !thread->objectName().isEmpty()
+            ? thread->objectName() : QString("thread %1").arg(buffer->tid);
+    s_buffers.append(buffer);
+    t_buffer = buffer;
+    return buffer;
+}
+
+void appendEscaped(QByteArray &out, const QByteArray &text)
+{
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+}
+
+} // namespace
+
+void Tracer::setSampleRate(double rate)
+{
+    quint32 period = 0;
+    if (rate > 0) {
+        double every = qRound64(1.0 / qMin(rate, 1.0));
+        period = static_cast<quint32>(qBound(1.0, every, 4294967295.0));
+    }
+    s_samplePeriod.storeRelaxed(period);
+}
+
+double Tracer::sampleRate()
+{
+    quint32 period = s_samplePeriod.loadRelaxed();
+    return period ? 1.0 / period : 0.0;
+}
+
+quint64 Tracer::sampleTrace()
+{
+    quint32 period = s_samplePeriod.loadRelaxed();
+    if (period == 0)
+        return 0;
+
+    // 按线程计数，固定间隔采样，不需要随机数
+    if (++t_sampleCounter < period)
+        return 0;
+    t_sampleCounter = 0;
+    return s_lastTraceId.fetchAndAddRelaxed(1) + 1;
+}
+
+quint64 Tracer::currentTrace()
+{
+    return t_currentTrace;
+}
+
+void Tracer::record(const char *name, quint64 traceId, qint64 startNs, qint64 endNs)
+{
+    if (traceId == 0)
+        return;
+
+    ThreadBuffer *buffer = threadBuffer();
+    quint64 head = buffer->head.loadRelaxed();
+    TraceEvent &event = buffer->events[head & (BufferCapacity - 1)];
+
+    // 顺序锁：先把序号改成奇数，写完字段再改回偶数，读取方据此丢弃写了一半的事件
+    quint32 seq = event.seq.loadRelaxed();
+    event.seq.storeRelaxed(seq + 1);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name = name;
+    event.traceId = traceId;
+    event.startNs = startNs;
+    event.durationNs = qMax(Q_INT64_C(0), endNs - startNs);
+    event.seq.storeRelease(seq + 2);
+    buffer->head.storeRelease(head + 1);
+}
+
+const char *Tracer::intern(const QString &name)
+{
+    QMutexLocker locker(&s_registryMutex);
+    auto it = s_internedNames.find(name);
+    if (it == s_internedNames.end()) {
+        it = s_internedNames.insert(name, name.toUtf8());
+    }
+    return it.value().constData();
+}
+
+QByteArray Tracer::chromeTraceJson()
+{
+    QVector<ThreadBuffer*> buffers;
+    {
+        QMutexLocker locker(&s_registryMutex);
+        buffers = s_buffers;
+    }
+
+    QByteArray json;
+    json += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+
+    for (ThreadBuffer *buffer : qAsConst(buffers)) {
+        // 线程名元数据
+        if (!first)
+            json += ',';
+        first = false;
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(buffer->tid)
+                + ",\"args\":{\"name\":\"";
+        appendEscaped(json, buffer->threadName.toUtf8());
+        json += "\"}}";
+
+        quint64 head = buffer->head.loadAcquire();
+        quint64 begin = head > static_cast<quint64>(BufferCapacity) ? head - BufferCapacity : 0;
+        for (quint64 i = begin; i < head; ++i) {
+            const TraceEvent &event = buffer->events[i & (BufferCapacity - 1)];
+            quint32 seq = event.seq.loadAcquire();
+            if (seq & 1)
+                continue;
+            const char *name = event.name;
+            quint64 traceId = event.traceId;
+            qint64 startNs = event.startNs;
+            qint64 durationNs = event.durationNs;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (event.seq.loadRelaxed() != seq || !name)
+                continue;
+
+            // 时间单位是微秒
+            json += ",{\"name\":\"";
+            appendEscaped(json, QByteArray(name));
+            json += "\",\"cat\":\"chat\",\"ph\":\"X\",\"pid\":1,\"tid\":" + QByteArray::number(buffer->tid)
+                    + ",\"ts\":" + QByteArray::number(startNs / 1000.0, 'f', 3)
+                    + ",\"dur\":" + QByteArray::number(durationNs / 1000.0, 'f', 3)
+                    + ",\"args\":{\"trace_id\":" + QByteArray::number(traceId) + "}}";
+        }
+    }
+
+    json += "]}";
+    return json;
+}
+
+bool Tracer::writeChromeTrace(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return file.write(chromeTraceJson()) >= 0;
+}
+
+Tracer::Scope::Scope(quint64 traceId)
+    : m_previous(t_currentTrace)
+{
+    t_currentTrace = traceId;
+}
+
+Tracer::Scope::~Scope()
+{
+    t_currentTrace = m_previous;
+}
+
+TraceSpan::TraceSpan(const char *name, quint64 traceId)
+    : m_name(name)
+    , m_traceId(traceId)
+    , m_startNs(traceId ? MetricsRegistry::nowNs() : 0)
+{
+}
+
+TraceSpan::~TraceSpan()
+{
+    if (m_traceId) {
+        Tracer::record(m_name, m_traceId, m_startNs, MetricsRegistry::nowNs());
+    }
+}
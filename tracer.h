@@ -0,0 +1,62 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QByteArray>
+#include <QString>
+
+// 按采样率跟踪单条消息在服务器内的各个阶段（解码、分发、扇出、写socket、落盘），
+// 导出为Chrome trace_event JSON（chrome://tracing 或 Perfetto 打开）。
+// 每个线程写自己的环形缓冲区，记录时不加锁；缓冲区写满后覆盖最旧的事件。
+// 采样率为0时每条消息只多一次原子读
+class Tracer
+{
+public:
+    // 0关闭，1跟踪每条消息，0.01约每100条跟踪一条
+    static void setSampleRate(double rate);
+    static double sampleRate();
+
+    // 在消息入口调用：被采样时返回新的trace id，否则返回0
+    static quint64 sampleTrace();
+
+    // 当前线程正在处理的trace id，由Scope设置；下游阶段（如入库、发帧）据此继承
+    static quint64 currentTrace();
+
+    // 记录一段已结束的区间，时间取自MetricsRegistry::nowNs()；name必须长期有效（字面量或intern()的结果）
+    static void record(const char *name, quint64 traceId, qint64 startNs, qint64 endNs);
+
+    // 把运行时拼出的名字转换成长期有效的字符串，同名只保存一份
+    static const char *intern(const QString &name);
+
+    // 所有线程缓冲区中现存的事件
+    static QByteArray chromeTraceJson();
+    static bool writeChromeTrace(const QString &path);
+
+    // 每个线程缓冲区的事件数，必须是2的幂
+    static constexpr int BufferCapacity = 16384;
+
+    // 在作用域内设置当前线程的trace id，退出时恢复
+    class Scope
+    {
+    public:
+        explicit Scope(quint64 traceId);
+        ~Scope();
+
+    private:
+        quint64 m_previous;
+    };
+};
+
+// 作用域区间：traceId为0时什么也不做
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, quint64 traceId = Tracer::currentTrace());
+    ~TraceSpan();
+
+private:
+    const char *m_name;
+    quint64 m_traceId;
+    qint64 m_startNs;
+};
+
+#endif // TRACER_H
@@ -0,0 +1,172 @@
+#include "wirecodec.h"
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QCborValue>
+#include <QCborMap>
+#include <QCborArray>
+#include <QHash>
+#include <QtEndian>
+
+// 整数key表，只能在末尾追加，不能调整已有顺序
+static const char *const CompactKeys[] = {
+    "type",
+    "sender",
+    "receiver",
+    "content",
+    "timestamp",
+    "group_name",
+    "username",
+    "id",
+    "message_type",
+    "messages",
+    "contacts",
+    "groups",
+    "nickname",
+    "status",
+    "password",
+    "message",
+    "target",
+    "members"
+};
+static const int CompactKeyCount = static_cast<int>(sizeof(CompactKeys) / sizeof(CompactKeys[0]));
+
+static const QHash<QString, int> &compactKeyIndex()
+{
+    static const QHash<QString, int> index = []() {
+        QHash<QString, int> keys;
+        for (int i = 0; i < CompactKeyCount; ++i) {
+            keys.insert(QString::fromLatin1(CompactKeys[i]), i);
+        }
+        return keys;
+    }();
+    return index;
+}
+
+static QCborValue toCbor(const QJsonValue &value);
+
+static QCborMap toCborMap(const QJsonObject &object)
+{
+    const QHash<QString, int> &keys = compactKeyIndex();
+    QCborMap map;
+    for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+        auto key = keys.constFind(it.key());
+        if (key != keys.constEnd()) {
+            map.insert(static_cast<qint64>(key.value()), toCbor(it.value()));
+        } else {
+            map.insert(it.key(), toCbor(it.value()));
+        }
+    }
+    return map;
+}
+
+static QCborValue toCbor(const QJsonValue &value)
+{
+    if (value.isObject())
+        return toCborMap(value.toObject());
+
+    if (value.isArray()) {
+        QCborArray array;
+        const QJsonArray jsonArray = value.toArray();
+        for (const QJsonValue &item : jsonArray) {
+            array.append(toCbor(item));
+        }
+        return array;
+    }
+
+    return QCborValue::fromJsonValue(value);
+}
+
+static QJsonValue fromCbor(const QCborValue &value);
+
+static QJsonObject fromCborMap(const QCborMap &map)
+{
+    QJsonObject object;
+    for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+        QString key;
+        if (it.key().isInteger()) {
+            qint64 index = it.key().toInteger();
+            key = (index >= 0 && index < CompactKeyCount) ? QString::fromLatin1(CompactKeys[index])
+                                                          : QString::number(index);
+        } else {
+            key = it.key().toString();
+        }
+        object.insert(key, fromCbor(it.value()));
+    }
+    return object;
+}
+
+static QJsonValue fromCbor(const QCborValue &value)
+{
+    if (value.isMap())
+        return fromCborMap(value.toMap());
+
+    if (value.isArray()) {
+        QJsonArray array;
+        const QCborArray cborArray = value.toArray();
+        for (const QCborValue &item : cborArray) {
+            array.append(fromCbor(item));
+        }
+        return array;
+    }
+
+    return value.toJsonValue();
+}
+
+QByteArray WireCodec::encode(const QJsonObject &json, Encoding encoding)
+{
+    if (encoding == Cbor)
+        return toCborMap(json).toCborValue().toCbor();
+
+    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+bool WireCodec::decode(const QByteArray &payload, QJsonObject *json)
+{
+    if (payload.isEmpty())
+        return false;
+
+    // 紧凑JSON对象总是以'{'开头，CBOR的map头不会是这个字节
+    if (payload.at(0) == '{') {
+        QJsonParseError error;
+        QJsonDocument doc = QJsonDocument::fromJson(payload, &error);
+        if (error.error != QJsonParseError::NoError || !doc.isObject())
+            return false;
+        *json = doc.object();
+        return true;
+    }
+
+    QCborParserError error;
+    QCborValue value = QCborValue::fromCbor(payload, &error);
+    if (error.error != QCborError::NoError || !value.isMap())
+        return false;
+    *json = fromCborMap(value.toMap());
+    return true;
+}
+
+QByteArray WireCodec::frame(const QByteArray &payload)
+{
+    QByteArray packet;
+    packet.reserve(static_cast<int>(sizeof(quint32)) + payload.size());
+    packet.resize(sizeof(quint32));
+    qToBigEndian(static_cast<quint32>(payload.size()), packet.data());
+    packet.append(payload);
+    return packet;
+}
+
+QString WireCodec::encodingName(Encoding encoding)
+{
+    return encoding == Cbor ? QStringLiteral("cbor") : QStringLiteral("json");
+}
+
+bool WireCodec::encodingFromName(const QString &name, Encoding *encoding)
+{
+    if (name == QLatin1String("cbor")) {
+        *encoding = Cbor;
+        return true;
+    }
+    if (name == QLatin1String("json")) {
+        *encoding = Json;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,29 @@
+#ifndef WIRECODEC_H
+#define WIRECODEC_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+
+// 帧内数据的编码：默认紧凑JSON；双方握手后可以切换为CBOR，
+// 常用字段名用整数key代替，减少带宽和解析开销
+class WireCodec
+{
+public:
+    enum Encoding {
+        Json,
+        Cbor
+    };
+
+    static QByteArray encode(const QJsonObject &json, Encoding encoding);
+    // 按首字节自动识别JSON或CBOR，同一端口上新旧客户端可以混用
+    static bool decode(const QByteArray &payload, QJsonObject *json);
+
+    // 给数据加上4字节大端长度头
+    static QByteArray frame(const QByteArray &payload);
+
+    static QString encodingName(Encoding encoding);
+    static bool encodingFromName(const QString &name, Encoding *encoding);
+};
+
+#endif // WIRECODEC_H